@@ -25,6 +25,14 @@ void NanoParticle::updateStep(int cpmdstep){}
 //update the number of samples used for density profile
 void NanoParticle::updateSamples(double density_profile_samples){}
 
+//sums of the density profile sampling
+void NanoParticle::getAccumulators(vector<double> &accumulators){accumulators.clear();}
+
+bool NanoParticle::setAccumulators(const vector<double> &accumulators){return accumulators.empty();}
+
+//names of the density sample columns
+void NanoParticle::getDensityColumns(vector<string> &names){names.clear();}
+
 //get NP type
 string NanoParticle::getType(){return "";}
 
@@ -240,12 +248,11 @@ void NanoParticle::put_saltions_outside(vector<PARTICLE> &saltion_out, int valen
     return;
 }
 
-// discretize interface
-void NanoParticle::discretize(vector<VERTEX> &s, double radius) {
+// grid file that discretizes the interface
+string NanoParticle::grid_filename(double radius) {
 
     char filename[200];
 
-
     //change infiles folder if nanoparticle radius changes; for a = 2.67m nm = 7.5 sigma in reduced units, infiles_a7.5 is the folder
     if(shape_id == 0){
         sprintf(filename, "infiles_a%.1f/grid%d.dat",
@@ -254,8 +261,15 @@ void NanoParticle::discretize(vector<VERTEX> &s, double radius) {
         sprintf(filename, "infiles_a%.1f_disk/grid%d.dat",
                 radius, number_of_vertices);
     }
+    return string(filename);
+}
+
+// discretize interface
+void NanoParticle::discretize(vector<VERTEX> &s, double radius) {
+
+    string filename = grid_filename(radius);
 
-    ifstream in(filename, ios::in);
+    ifstream in(filename.c_str(), ios::in);
     if (!in) {
         if (world.rank() == 0)
             cout << "File could not be opened" << endl;
@@ -11,8 +11,12 @@
 #include "control.h"
 #include "BinShell.h"
 #include "BinRing.h"
+#include "histogram.h"
 #include "thermostat.h"
 #include "mpi_utility.h"
+#include "operator_store.h"
+#include "polarization_solver.h"
+#include "surface_field.h"
 
 
 
@@ -70,10 +74,16 @@ public:
     bool POLARIZED;        // is the nanoparticle polarized; depends on ein, eout
     bool RANDOMIZE_ION_FEATURES;    // are selections randomized
     int shape_id = -1;                   //Shape id number -> initialized to non type
+    OperatorStore operators;        // precalculated interface operators (rows of this process)
+    PolarizationSolver solver;        // direct solver of the induced charges (unused for cpmd)
+    SurfaceField surface_field;       // potential and field of the fixed charges realQ on the ions
+    vector<double> inefficiency;      // statistical inefficiency of each density column (none: independent samples)
 
     // make a particle constructor
     NanoParticle();
 
+    virtual ~NanoParticle() {}
+
     // member functions definitions
 
     void set_up(double, double, double, double, int, double);
@@ -86,6 +96,9 @@ public:
 
     void discretize(vector<VERTEX> &, double);
 
+    // grid file used to discretize the interface
+    string grid_filename(double);
+
     // total charge inside
     double total_charge_inside(vector<PARTICLE> &);
 
@@ -99,7 +112,7 @@ public:
     // make bins for disk
     virtual void make_bins();
 
-    // bin ions to get density profile for disk
+    // bin ions to get density profile (collective)
     virtual void bin_ions();
 
     // compute initial density profile
@@ -120,6 +133,15 @@ public:
     //update the number of samples used for density profile
     virtual void updateSamples(double );
 
+    // sums of the density profile sampling, in one array (for checkpoints)
+    virtual void getAccumulators(vector<double> &);
+
+    // false if the array does not fit the bins
+    virtual bool setAccumulators(const vector<double> &);
+
+    // names of the densities of a sample (positive bins, then negative), as in the density sample series
+    virtual void getDensityColumns(vector<string> &);
+
     //get NP type
     virtual string getType();
 
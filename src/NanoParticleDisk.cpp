@@ -1,6 +1,9 @@
 // This is particle class
 
 #include "NanoParticleDisk.h"
+#include "output.h"
+#include "series.h"
+#include <sstream>
 
 
 NanoParticleDisk::NanoParticleDisk(string shape, vector<vector<BinRing> > &bin_posL, vector<vector<BinRing> > &bin_negL, double bin_width_RL,
@@ -62,6 +65,11 @@ void NanoParticleDisk::make_bins() {
         listbin.close();
     }
 
+    // the densities of one sample and the bin counts, filled in place at every sample
+    density_pos.assign(bin_pos.size(), vector<double>(bin_pos[0].size()));
+    density_neg.assign(bin_neg.size(), vector<double>(bin_neg[0].size()));
+    histogram.set_up(bin_pos.size() * bin_pos[0].size());
+
     mean_density_pos.resize(bin_pos.size(), vector<double>(bin_pos[0].size()));
     mean_sq_density_pos.resize(bin_pos.size(), vector<double>(bin_pos[0].size()));
     mean_density_neg.resize(bin_neg.size(), vector<double>(bin_neg[0].size()));
@@ -73,31 +81,26 @@ void NanoParticleDisk::make_bins() {
 // bin ions to get density profile for disk
 void NanoParticleDisk::bin_ions() {
 
+    int bins_Z = bin_pos.size();
+    int bins_R = bin_pos[0].size();
+    double width_Z = bin_pos[0][0].width_Z;
+    double width_R = bin_pos[0][0].width_R;
+    histogram.fill(*ion, [bins_Z, bins_R, width_Z, width_R](const PARTICLE &p) {
+        int binNumberZ = int(fabs(p.posvec.z) / width_Z);
+        int binNumberR = int(sqrt(pow(p.posvec.x, 2) + pow(p.posvec.y, 2)) / width_R);
+        return binNumberZ < bins_Z && binNumberR < bins_R ? binNumberZ * bins_R + binNumberR : -1;
+    });
+    if (world.rank() != 0)
+        return;
+
+    int bins = bins_Z * bins_R;
     for (unsigned int bin_num_Z = 0; bin_num_Z < bin_pos.size(); bin_num_Z++)
         for (unsigned int bin_num_R = 0; bin_num_R < bin_pos[bin_num_Z].size(); bin_num_R++) {
-            bin_pos[bin_num_Z][bin_num_R].n = 0;
-            bin_neg[bin_num_Z][bin_num_R].n = 0;
-        }
-    for (unsigned int i = 0; i < (*ion).size(); i++) {
-
-        int binNumberZ = int(fabs((*ion)[i].posvec.z) / bin_pos[0][0].width_Z);
-        int binNumberR = int(sqrt(pow((*ion)[i].posvec.x, 2) + pow((*ion)[i].posvec.y, 2)) / bin_pos[0][0].width_R);
-
-        if ((*ion)[i].valency > 0) {
-            bin_pos[binNumberZ][binNumberR].n = bin_pos[binNumberZ][binNumberR].n + 1;
-        }else{
-            //Assuming 0 valency never exists
-            bin_neg[binNumberZ][binNumberR].n = bin_neg[binNumberZ][binNumberR].n + 1;
-        }
-    }
-
-    density_pos.resize(bin_pos.size(), vector<double>(bin_pos[0].size()));
-    density_neg.resize(bin_neg.size(), vector<double>(bin_neg[0].size()));
-
-    for (unsigned int bin_num_Z = 0; bin_num_Z < bin_pos.size(); bin_num_Z++)
-        for (unsigned int bin_num_R = 0; bin_num_R < bin_pos[bin_num_Z].size(); bin_num_R++) {
+            int b = bin_num_Z * bins_R + bin_num_R;
+            bin_pos[bin_num_Z][bin_num_R].n = histogram.counts[b];
+            bin_neg[bin_num_Z][bin_num_R].n = histogram.counts[bins + b];
             density_pos[bin_num_Z][bin_num_R] = bin_pos[bin_num_Z][bin_num_R].n /
-                                            bin_pos[bin_num_Z][bin_num_R].volume;            // push_back is the culprit, array goes out of bound
+                                            bin_pos[bin_num_Z][bin_num_R].volume;
             density_neg[bin_num_Z][bin_num_R] = bin_neg[bin_num_Z][bin_num_R].n /
                                             bin_neg[bin_num_Z][bin_num_R].volume;
         }
@@ -107,11 +110,9 @@ void NanoParticleDisk::bin_ions() {
 // compute initial density profile
 void NanoParticleDisk::compute_initial_density_profile() {
 
-    density_pos.clear();
-    density_neg.clear();
+    bin_ions();
 
     if (world.rank() == 0) {
-        bin_ions();
         ofstream density_pos_profile("outfiles/initial_positive_density_profile.dat", ios::out);
         ofstream density_neg_profile("outfiles/initial_negative_density_profile.dat", ios::out);
 
@@ -132,13 +133,10 @@ void NanoParticleDisk::compute_initial_density_profile() {
 // compute density profile disk
 void NanoParticleDisk::compute_density_profile() {
 
-    density_pos.clear();
-    density_neg.clear();
+    bin_ions();
 
     if (world.rank() == 0) {
-        ofstream file_for_auto_corr("outfiles/for_auto_corr.dat", ios::app);
-
-        bin_ions();
+        ostringstream file_for_auto_corr;
 
         for (unsigned int b = 0; b < mean_density_pos.size(); b++)
             for (unsigned int c = 0; c < mean_density_pos[b].size(); c++) {
@@ -152,6 +150,14 @@ void NanoParticleDisk::compute_density_profile() {
                 mean_sq_density_neg[b][c] = mean_sq_density_neg[b][c] + (density_neg[b][c] * density_neg[b][c]);
             }
 
+        // the sample, for the error analysis at the end
+        vector<double> sample;
+        for (unsigned int b = 0; b < density_pos.size(); b++)
+            sample.insert(sample.end(), density_pos[b].begin(), density_pos[b].end());
+        for (unsigned int b = 0; b < density_neg.size(); b++)
+            sample.insert(sample.end(), density_neg[b].begin(), density_neg[b].end());
+        series.density.append(cpmdstep, sample);
+
         // write a file for post analysis to get auto correlation time		// NOTE this is assuming ions do not cross the interface
         //Only used positive ion densities here
         if ((*ion)[0].posvec.GetMagnitude() > radius)
@@ -162,15 +168,14 @@ void NanoParticleDisk::compute_density_profile() {
             file_for_auto_corr << cpmdstep - cpmdremote.hiteqm << "\t"
                                << density_pos[int((radius - 2) / bin_pos[0][0].width_Z)][int(
                                        (radius - 2) / bin_pos[0][0].width_R)] << endl;
+        output.append("outfiles/for_auto_corr.dat", file_for_auto_corr.str());
 
         // write files
         if (cpmdstep % cpmdremote.writedensity == 0) {
             char data_pos[200], data_neg[200];
             sprintf(data_pos, "datafiles/_den_pos_%.06d.dat", cpmdstep);
             sprintf(data_neg, "datafiles/_den_neg_%.06d.dat", cpmdstep);
-            ofstream outden_pos, outden_neg;
-            outden_pos.open(data_pos);
-            outden_neg.open(data_neg);
+            ostringstream outden_pos, outden_neg;
             for (unsigned int b = 0; b < mean_density_pos.size(); b++)
                 for (unsigned int c = 0; c < mean_density_pos[b].size(); c++) {
                     outden_pos << b * bin_pos[b][c].width_Z << setw(15) << c * bin_pos[b][c].width_R << setw(15)
@@ -179,8 +184,8 @@ void NanoParticleDisk::compute_density_profile() {
                            << mean_density_neg[b][c] / density_profile_samples << endl;
 
                 }
-            outden_pos.close();
-            outden_neg.close();
+            output.write(data_pos, outden_pos.str());
+            output.write(data_neg, outden_neg.str());
         }
     }
     return;
@@ -200,7 +205,9 @@ void NanoParticleDisk::compute_final_density_profile() {
                 density_profile_neg[b][c] = (mean_density_neg[b][c] / density_profile_samples);
             }
 
-        // 2. error bars
+        // 2. error bars (widened by the statistical inefficiency of the bin when the samples were analysed)
+        unsigned int rings = bin_pos[0].size(), bins = bin_pos.size() * rings;
+        bool correlated = inefficiency.size() == 2 * bins;
         vector<vector<double> > error_bar_disk_pos;
         vector<vector<double> > error_bar_disk_neg;
         error_bar_disk_pos.resize(bin_pos.size(), vector<double>(bin_pos[0].size()));
@@ -213,6 +220,10 @@ void NanoParticleDisk::compute_final_density_profile() {
                 error_bar_disk_neg[b][c] =
                         sqrt(1.0 / density_profile_samples) * sqrt(mean_sq_density_neg[b][c] / density_profile_samples -
                                                                    density_profile_neg[b][c] * density_profile_neg[b][c]);
+                if (correlated) {
+                    error_bar_disk_pos[b][c] *= sqrt(inefficiency[b * rings + c]);
+                    error_bar_disk_neg[b][c] *= sqrt(inefficiency[bins + b * rings + c]);
+                }
             }
 
         // 3. write results
@@ -244,6 +255,53 @@ void NanoParticleDisk::updateSamples(double density_profile_samplesL) {
 
 }
 
+// the sums of the positive and negative densities and of their squares, each Z row of bins after the other
+void NanoParticleDisk::getAccumulators(vector<double> &accumulators) {
+
+    accumulators.clear();
+    vector<vector<double> > *sums[4] = {&mean_density_pos, &mean_sq_density_pos, &mean_density_neg,
+                                        &mean_sq_density_neg};
+    for (unsigned int n = 0; n < 4; n++)
+        for (unsigned int b = 0; b < sums[n]->size(); b++)
+            accumulators.insert(accumulators.end(), (*sums[n])[b].begin(), (*sums[n])[b].end());
+}
+
+bool NanoParticleDisk::setAccumulators(const vector<double> &accumulators) {
+
+    vector<vector<double> > *sums[4] = {&mean_density_pos, &mean_sq_density_pos, &mean_density_neg,
+                                        &mean_sq_density_neg};
+    unsigned int size = 0;
+    for (unsigned int n = 0; n < 4; n++)
+        for (unsigned int b = 0; b < sums[n]->size(); b++)
+            size += (*sums[n])[b].size();
+    if (accumulators.size() != size)
+        return false;
+    vector<double>::const_iterator from = accumulators.begin();
+    for (unsigned int n = 0; n < 4; n++)
+        for (unsigned int b = 0; b < sums[n]->size(); b++) {
+            copy(from, from + (*sums[n])[b].size(), (*sums[n])[b].begin());
+            from += (*sums[n])[b].size();
+        }
+    return true;
+}
+
+// a sample is the positive then the negative densities of the rings, z bin after z bin
+void NanoParticleDisk::getDensityColumns(vector<string> &names) {
+
+    names.clear();
+    char name[24];
+    for (unsigned int b = 0; b < mean_density_pos.size(); b++)
+        for (unsigned int c = 0; c < mean_density_pos[b].size(); c++) {
+            sprintf(name, "pos_%u_%u", b, c);
+            names.push_back(name);
+        }
+    for (unsigned int b = 0; b < mean_density_neg.size(); b++)
+        for (unsigned int c = 0; c < mean_density_neg[b].size(); c++) {
+            sprintf(name, "neg_%u_%u", b, c);
+            names.push_back(name);
+        }
+}
+
 string NanoParticleDisk::getType() {
 
     return np_shape;
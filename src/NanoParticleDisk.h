@@ -13,6 +13,7 @@ private:
     vector<PARTICLE> *ion;
     vector<vector<double> > density_pos;
     vector<vector<double> > density_neg;
+    Histogram histogram;                                    // counts of the bins (Z major), summed over threads and processes
     int cpmdstep;
     double density_profile_samples;
     vector<vector<double> > mean_density_pos;                // average density profile of 2D sampling
@@ -32,7 +33,7 @@ public:
 // make bins for disk
     void make_bins();
 
-    // bin ions to get density profile for disk
+    // bin ions to get density profile for disk (on all processes; the densities are on the first)
     void bin_ions();
 
     // compute initial density profile
@@ -48,6 +49,12 @@ public:
 
     void updateSamples(double );
 
+    void getAccumulators(vector<double> &);
+
+    bool setAccumulators(const vector<double> &);
+
+    void getDensityColumns(vector<string> &);
+
     string getType();
 
     void printType();
@@ -1,4 +1,7 @@
 #include "NanoParticleSphere.h"
+#include "output.h"
+#include "series.h"
+#include <sstream>
 
 NanoParticleSphere::NanoParticleSphere(string shape, vector<BinShell> &bin_pos_L, vector<BinShell> &bin_neg_L,
                                        double bin_widthL,
@@ -49,6 +52,11 @@ void NanoParticleSphere::make_bins() {
         listbin.close();
     }
 
+    // the densities of one sample and the bin counts, filled in place at every sample
+    density_pos.assign(bin_pos.size(), 0.0);
+    density_neg.assign(bin_neg.size(), 0.0);
+    histogram.set_up(bin_pos.size());
+
     //set mean and mean sq vectors
     for (unsigned int b = 0; b < bin_pos.size(); b++) {
         mean_pos_density.push_back(0.0);
@@ -62,30 +70,20 @@ void NanoParticleSphere::make_bins() {
 
 // bin ions to get density profile
 void NanoParticleSphere::bin_ions() {
-    double r;
-    int bin_number;
-    for (unsigned int bin_num = 0; bin_num < bin_pos.size(); bin_num++) {
-        bin_pos[bin_num].n = 0;
-        bin_neg[bin_num].n = 0;
-    }
-    for (unsigned int i = 0; i < (*ion).size(); i++) {
-        r = (*ion)[i].posvec.GetMagnitude();
-        bin_number = int(r / bin_pos[0].width);
-        if ((*ion)[i].valency > 0) {
-            bin_pos[bin_number].n = bin_pos[bin_number].n + 1;
-        } else {
-            //Assuming 0 valency never exists
-            bin_neg[bin_number].n = bin_neg[bin_number].n + 1;
-        }
-    }
+    int bins = bin_pos.size();
+    double width = bin_pos[0].width;
+    histogram.fill(*ion, [bins, width](const PARTICLE &p) {
+        VECTOR3D r = p.posvec;
+        int bin_number = int(r.GetMagnitude() / width);
+        return bin_number < bins ? bin_number : -1;
+    });
+    if (world.rank() != 0)
+        return;
     for (unsigned int bin_num = 0; bin_num < bin_pos.size(); bin_num++) {
-        density_pos.push_back(
-                bin_pos[bin_num].n /
-                bin_pos[bin_num].volume);            // push_back is the culprit, array goes out of bound
-
-        density_neg.push_back(
-                bin_neg[bin_num].n /
-                bin_neg[bin_num].volume);            // push_back is the culprit, array goes out of bound
+        bin_pos[bin_num].n = histogram.counts[bin_num];
+        bin_neg[bin_num].n = histogram.counts[bins + bin_num];
+        density_pos[bin_num] = bin_pos[bin_num].n / bin_pos[bin_num].volume;
+        density_neg[bin_num] = bin_neg[bin_num].n / bin_neg[bin_num].volume;
     }
     return;
 }
@@ -94,10 +92,8 @@ void NanoParticleSphere::bin_ions() {
 // compute initial density profile
 void NanoParticleSphere::compute_initial_density_profile() {
 
-    density_pos.clear();
-    density_neg.clear();
+    bin_ions();
     if (world.rank() == 0) {
-        bin_ions();
         ofstream density_profile_pos("outfiles/initial_positive_density_profile.dat", ios::out);
         ofstream density_profile_neg("outfiles/initial_negative_density_profile.dat", ios::out);
 
@@ -114,13 +110,10 @@ void NanoParticleSphere::compute_initial_density_profile() {
 // compute density profile
 void NanoParticleSphere::compute_density_profile() {
 
-    density_pos.clear();
-    density_neg.clear();
+    bin_ions();
 
     if (world.rank() == 0) {
-        ofstream file_for_auto_corr("outfiles/for_auto_corr.dat", ios::app);
-
-        bin_ions();
+        ostringstream file_for_auto_corr;
 
         for (unsigned int b = 0; b < mean_pos_density.size(); b++)
             mean_pos_density.at(b) = mean_pos_density.at(b) + density_pos.at(b);
@@ -131,6 +124,11 @@ void NanoParticleSphere::compute_density_profile() {
         for (unsigned int b = 0; b < density_neg.size(); b++)
             mean_neg_sq_density.at(b) = mean_neg_sq_density.at(b) + density_neg.at(b) * density_neg.at(b);
 
+        // the sample, for the error analysis at the end
+        vector<double> sample(density_pos);
+        sample.insert(sample.end(), density_neg.begin(), density_neg.end());
+        series.density.append(cpmdstep, sample);
+
         // write a file for post analysis to get auto correlation time		// NOTE this is assuming ions do not cross the interface
         //Only used positive ion densities here
         if ((*ion)[0].posvec.GetMagnitude() > radius)
@@ -139,23 +137,22 @@ void NanoParticleSphere::compute_density_profile() {
         else
             file_for_auto_corr << cpmdstep - cpmdremote.hiteqm << "\t"
                                << density_pos[int((radius - 2) / bin_pos[0].width)] << endl;
+        output.append("outfiles/for_auto_corr.dat", file_for_auto_corr.str());
 
         // write files
         if (cpmdstep % cpmdremote.writedensity == 0) {
             char data_pos[200], data_neg[200];
             sprintf(data_pos, "datafiles/_den_pos_%.06d.dat", cpmdstep);
             sprintf(data_neg, "datafiles/_den_neg_%.06d.dat", cpmdstep);
-            ofstream outden_pos, outden_neg;
-            outden_pos.open(data_pos);
-            outden_neg.open(data_neg);
+            ostringstream outden_pos, outden_neg;
             for (unsigned int b = 0; b < mean_pos_density.size(); b++) {
                 outden_pos << b * bin_pos[b].width << setw(15) << mean_pos_density.at(b) / density_profile_samples
                            << endl;
                 outden_neg << b * bin_neg[b].width << setw(15) << mean_neg_density.at(b) / density_profile_samples
                            << endl;
             }
-            outden_pos.close();
-            outden_neg.close();
+            output.write(data_pos, outden_pos.str());
+            output.write(data_neg, outden_neg.str());
         }
     }
     return;
@@ -176,16 +173,22 @@ void NanoParticleSphere::compute_final_density_profile() {
             density_profile_neg.push_back(mean_neg_density.at(b) / density_profile_samples);
         }
 
-        // 2. error bars
+        // 2. error bars (widened by the statistical inefficiency of the bin when the samples were analysed)
+        unsigned int bins = density_profile_pos.size();
+        bool correlated = inefficiency.size() == 2 * bins;
         vector<double> error_bar_pos;
         vector<double> error_bar_neg;
-        for (unsigned int b = 0; b < density_profile_pos.size(); b++) {
+        for (unsigned int b = 0; b < bins; b++) {
             error_bar_pos.push_back(
                     sqrt(1.0 / density_profile_samples) * sqrt(mean_pos_sq_density.at(b) / density_profile_samples -
                                                                density_profile_pos.at(b) * density_profile_pos.at(b)));
             error_bar_neg.push_back(
                     sqrt(1.0 / density_profile_samples) * sqrt(mean_neg_sq_density.at(b) / density_profile_samples -
                                                                density_profile_neg.at(b) * density_profile_neg.at(b)));
+            if (correlated) {
+                error_bar_pos.at(b) *= sqrt(inefficiency.at(b));
+                error_bar_neg.at(b) *= sqrt(inefficiency.at(bins + b));
+            }
         }
 
         // 3. write results
@@ -218,6 +221,44 @@ void NanoParticleSphere::updateSamples(double density_profile_samplesL) {
 
 }
 
+// the sums of the positive and negative densities and of their squares, bin after bin
+void NanoParticleSphere::getAccumulators(vector<double> &accumulators) {
+
+    accumulators.clear();
+    accumulators.insert(accumulators.end(), mean_pos_density.begin(), mean_pos_density.end());
+    accumulators.insert(accumulators.end(), mean_pos_sq_density.begin(), mean_pos_sq_density.end());
+    accumulators.insert(accumulators.end(), mean_neg_density.begin(), mean_neg_density.end());
+    accumulators.insert(accumulators.end(), mean_neg_sq_density.begin(), mean_neg_sq_density.end());
+}
+
+bool NanoParticleSphere::setAccumulators(const vector<double> &accumulators) {
+
+    unsigned int bins = mean_pos_density.size();
+    if (accumulators.size() != 4 * bins)
+        return false;
+    vector<double>::const_iterator from = accumulators.begin();
+    copy(from, from + bins, mean_pos_density.begin());
+    copy(from + bins, from + 2 * bins, mean_pos_sq_density.begin());
+    copy(from + 2 * bins, from + 3 * bins, mean_neg_density.begin());
+    copy(from + 3 * bins, from + 4 * bins, mean_neg_sq_density.begin());
+    return true;
+}
+
+// a sample is the positive then the negative densities of the shells
+void NanoParticleSphere::getDensityColumns(vector<string> &names) {
+
+    names.clear();
+    char name[24];
+    for (unsigned int b = 0; b < mean_pos_density.size(); b++) {
+        sprintf(name, "pos_%u", b);
+        names.push_back(name);
+    }
+    for (unsigned int b = 0; b < mean_neg_density.size(); b++) {
+        sprintf(name, "neg_%u", b);
+        names.push_back(name);
+    }
+}
+
 string NanoParticleSphere::getType() {
 
     return np_shape;
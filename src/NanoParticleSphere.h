@@ -13,6 +13,7 @@ private:
     vector<PARTICLE> *ion;
     vector<double> density_pos;
     vector<double> density_neg;
+    Histogram histogram;                            // counts of the bins, summed over threads and processes
     int cpmdstep;
     double density_profile_samples;
     vector<double> mean_pos_density;                // average density profile
@@ -31,7 +32,7 @@ public:
     // make bins for disk
     void make_bins() ;
 
-// bin ions to get density profile
+// bin ions to get density profile (on all processes; the densities are on the first)
     void bin_ions() ;
 
     // compute initial density profile
@@ -47,6 +48,12 @@ public:
 
     void updateSamples(double density_profile_samplesL) ;
 
+    void getAccumulators(vector<double> &);
+
+    bool setAccumulators(const vector<double> &);
+
+    void getDensityColumns(vector<string> &);
+
     string getType() ;
 
     void printType();
@@ -0,0 +1,161 @@
+// This file contains the error analysis of the density samples
+
+#include "analysis.h"
+#include "series.h"
+
+#include <cmath>
+#include <complex>
+#include <omp.h>
+
+// in place radix 2 FFT of a (size a power of 2); inverse without the 1 / n
+static void fft(vector<complex<double> > &a, bool inverse) {
+
+    unsigned int n = a.size();
+    for (unsigned int i = 1, j = 0; i < n; i++) {
+        unsigned int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            swap(a[i], a[j]);
+    }
+    for (unsigned int length = 2; length <= n; length <<= 1) {
+        double angle = 2 * M_PI / length * (inverse ? 1 : -1);
+        complex<double> w_length(cos(angle), sin(angle));
+        for (unsigned int i = 0; i < n; i += length) {
+            complex<double> w(1);
+            for (unsigned int k = 0; k < length / 2; k++) {
+                complex<double> u = a[i + k];
+                complex<double> v = a[i + k + length / 2] * w;
+                a[i + k] = u + v;
+                a[i + k + length / 2] = u - v;
+                w *= w_length;
+            }
+        }
+    }
+    return;
+}
+
+void autocorrelation(const vector<double> &x, vector<double> &rho) {
+
+    unsigned int n = x.size();
+    rho.assign(n, 0);
+    if (n == 0)
+        return;
+    double mean = 0;
+    for (unsigned int i = 0; i < n; i++)
+        mean += x[i];
+    mean /= n;
+
+    // zero padding to at least 2n keeps the circular correlation from wrapping around
+    unsigned int size = 1;
+    while (size < 2 * n)
+        size <<= 1;
+    vector<complex<double> > a(size, 0.0);
+    for (unsigned int i = 0; i < n; i++)
+        a[i] = x[i] - mean;
+    fft(a, false);
+    for (unsigned int i = 0; i < size; i++)
+        a[i] = norm(a[i]);
+    fft(a, true);
+
+    // C(t) = sum over i of dx(i) dx(i + t) / (n - t)
+    double c0 = a[0].real() / n;
+    if (c0 <= 0)
+        return;
+    for (unsigned int t = 0; t < n; t++)
+        rho[t] = a[t].real() / (n - t) / c0;
+    return;
+}
+
+double statistical_inefficiency(const vector<double> &rho) {
+
+    unsigned int n = rho.size();
+    double g = 1;
+    for (unsigned int t = 1; t < n; t++) {
+        if (rho[t] <= 0)
+            break;
+        g += 2 * rho[t] * (1 - double(t) / n);
+    }
+    return g;
+}
+
+double blocking_error(const vector<double> &x) {
+
+    vector<double> blocks(x);
+    vector<double> errors, uncertainties;
+    while (blocks.size() >= 2) {
+        unsigned int n = blocks.size();
+        double mean = 0, variance = 0;
+        for (unsigned int i = 0; i < n; i++)
+            mean += blocks[i];
+        mean /= n;
+        for (unsigned int i = 0; i < n; i++)
+            variance += (blocks[i] - mean) * (blocks[i] - mean);
+        variance /= n;
+        double error = sqrt(variance / (n - 1));
+        errors.push_back(error);
+        uncertainties.push_back(error / sqrt(2.0 * (n - 1)));
+        for (unsigned int i = 0; i < n / 2; i++)
+            blocks[i] = 0.5 * (blocks[2 * i] + blocks[2 * i + 1]);
+        blocks.resize(n / 2);
+    }
+    if (errors.empty())
+        return 0;
+
+    // the plateau: the first level the next one does not exceed by more than its uncertainty
+    for (unsigned int k = 0; k + 1 < errors.size(); k++)
+        if (errors[k + 1] <= errors[k] + uncertainties[k])
+            return errors[k];
+    return errors.back();
+}
+
+SAMPLE_STATISTICS sample_statistics(const vector<double> &x) {
+
+    SAMPLE_STATISTICS statistics;
+    unsigned int n = x.size();
+    statistics.samples = n;
+    statistics.mean = 0;
+    for (unsigned int i = 0; i < n; i++)
+        statistics.mean += x[i];
+    if (n > 0)
+        statistics.mean /= n;
+    double variance = 0;
+    for (unsigned int i = 0; i < n; i++)
+        variance += (x[i] - statistics.mean) * (x[i] - statistics.mean);
+    if (n > 0)
+        variance /= n;
+    if (variance <= 1e-24 * statistics.mean * statistics.mean)
+        variance = 0;           // a constant bin, up to rounding
+    statistics.naive_error = n > 0 ? sqrt(variance / n) : 0;
+
+    vector<double> rho;
+    autocorrelation(x, rho);
+    statistics.inefficiency = variance > 0 ? statistical_inefficiency(rho) : 1;
+    statistics.error = statistics.naive_error * sqrt(statistics.inefficiency);
+    statistics.blocking_error = blocking_error(x);
+    return statistics;
+}
+
+bool analyse_series(const string &path, vector<string> &names, vector<SAMPLE_STATISTICS> &statistics) {
+
+    SeriesReader in;
+    if (!in.open(path))
+        return false;
+    int columns = in.columns.size() - 1;
+    names.resize(columns);
+    statistics.resize(columns);
+    for (int c = 0; c < columns; c++)
+        names[c] = in.columns[c + 1].name;
+
+#pragma omp parallel default(shared)
+    {
+        vector<double> x;
+#pragma omp for schedule(dynamic)
+        for (int c = 0; c < columns; c++) {
+            in.column(c + 1, x);
+            statistics[c] = sample_statistics(x);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+// This is a header file for the error analysis of the density samples
+// The density of every bin at every sampling step goes into outfiles/density_samples.series. At the end of the run
+// each bin's samples are analysed independently (bins shared out over the OpenMP threads of the first process):
+//   - the autocorrelation function, from an FFT of the zero padded samples (O(n log n) rather than O(n ntau)),
+//     summed up to its first non-positive value to get the statistical inefficiency g (samples per independent one);
+//   - Flyvbjerg-Petersen blocking: the error of the mean from repeatedly halved block averages, taken where it stops
+//     rising (within its own uncertainty).
+// The error of the mean that treats the samples as independent, times sqrt(g), is the corrected error bar.
+
+#ifndef _ANALYSIS_H
+#define _ANALYSIS_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct SAMPLE_STATISTICS {
+    double samples;
+    double mean;
+    double naive_error;         // error of the mean for independent samples
+    double inefficiency;        // statistical inefficiency g = 1 + 2 sum of the autocorrelation function
+    double error;               // naive_error * sqrt(g)
+    double blocking_error;      // Flyvbjerg-Petersen estimate
+};
+
+// normalized autocorrelation function rho of x at lags 0 .. n - 1 (by FFT)
+void autocorrelation(const vector<double> &x, vector<double> &rho);
+
+// statistical inefficiency from the autocorrelation function of n samples
+double statistical_inefficiency(const vector<double> &rho);
+
+// error of the mean of x by Flyvbjerg-Petersen blocking
+double blocking_error(const vector<double> &x);
+
+// all of the above for one series of samples
+SAMPLE_STATISTICS sample_statistics(const vector<double> &x);
+
+// the statistics of every (non step) column of a series file, in column order; false if it cannot be read
+bool analyse_series(const string &path, vector<string> &names, vector<SAMPLE_STATISTICS> &statistics);
+
+#endif
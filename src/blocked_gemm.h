@@ -0,0 +1,52 @@
+// This is a header file for the blocked matrix-matrix multiply
+// used to build the precalculated interface operators (dense, row-major storage)
+
+#ifndef _BLOCKED_GEMM_H
+#define _BLOCKED_GEMM_H
+
+#include <omp.h>
+#include <algorithm>
+
+// tile sizes chosen so that one tile of A, B and C fits comfortably in L2 for 16 byte elements
+const unsigned int GEMM_BLOCK_M = 64;
+const unsigned int GEMM_BLOCK_N = 128;
+const unsigned int GEMM_BLOCK_K = 64;
+
+// C (M x N) = A (M x K) * B (K x N), all row-major with leading dimensions lda, ldb, ldc
+// tiles of C are distributed over OpenMP threads; each tile is owned by one thread, so no reduction is needed
+template<typename T>
+void blocked_gemm(unsigned int M, unsigned int N, unsigned int K, const T *A, unsigned int lda, const T *B,
+                  unsigned int ldb, T *C, unsigned int ldc) {
+
+    unsigned int blocks_m = (M + GEMM_BLOCK_M - 1) / GEMM_BLOCK_M;
+    unsigned int blocks_n = (N + GEMM_BLOCK_N - 1) / GEMM_BLOCK_N;
+    int total_blocks = blocks_m * blocks_n;
+
+#pragma omp parallel for schedule(dynamic) default(shared)
+    for (int block = 0; block < total_blocks; block++) {
+        unsigned int i0 = (block / blocks_n) * GEMM_BLOCK_M;
+        unsigned int j0 = (block % blocks_n) * GEMM_BLOCK_N;
+        unsigned int i1 = std::min(i0 + GEMM_BLOCK_M, M);
+        unsigned int j1 = std::min(j0 + GEMM_BLOCK_N, N);
+
+        for (unsigned int i = i0; i < i1; i++)
+            for (unsigned int j = j0; j < j1; j++)
+                C[i * ldc + j] = 0;
+
+        for (unsigned int k0 = 0; k0 < K; k0 += GEMM_BLOCK_K) {
+            unsigned int k1 = std::min(k0 + GEMM_BLOCK_K, K);
+            for (unsigned int i = i0; i < i1; i++) {
+                T *crow = C + i * ldc;
+                for (unsigned int k = k0; k < k1; k++) {
+                    const T aik = A[i * lda + k];
+                    const T *brow = B + k * ldb;
+                    for (unsigned int j = j0; j < j1; j++)
+                        crow[j] += aik * brow[j];
+                }
+            }
+        }
+    }
+    return;
+}
+
+#endif
@@ -0,0 +1,97 @@
+// This file contains the checkpoints of the cpmd run and the stop signals
+
+#include "checkpoint.h"
+#include "mpi_utility.h"
+
+#include <cstdio>
+#include <unistd.h>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+
+static volatile sig_atomic_t stop_signal = 0;
+
+static void request_stop(int) {
+    stop_signal = 1;
+}
+
+bool write_checkpoint(const string &path, const CHECKPOINT &state) {
+
+    int written = 0;
+    if (world.rank() == 0) {
+        char suffix[32];
+        sprintf(suffix, ".tmp%d", (int) getpid());
+        string temporary = path + suffix;
+        {
+            ofstream out(temporary.c_str(), ios::out | ios::binary | ios::trunc);
+            if (out) {
+                boost::archive::binary_oarchive archive(out);
+                archive << state;
+            }
+            out.close();
+            written = !out.fail();
+        }
+        if (written)
+            written = rename(temporary.c_str(), path.c_str()) == 0;
+        else
+            remove(temporary.c_str());
+    }
+    if (world.size() > 1)
+        broadcast(world, written, 0);
+    return written;
+}
+
+bool read_checkpoint(const string &path, CHECKPOINT &state) {
+
+    int read = 0;
+    if (world.rank() == 0) {
+        ifstream in(path.c_str(), ios::in | ios::binary);
+        if (in) {
+            try {
+                boost::archive::binary_iarchive archive(in);
+                archive >> state;
+                read = 1;
+            } catch (const std::exception &) {
+                read = 0;
+            }
+        }
+    }
+    if (world.size() > 1) {
+        broadcast(world, read, 0);
+        if (read)
+            broadcast(world, state, 0);
+    }
+    return read;
+}
+
+void StopRequest::install() {
+
+    struct sigaction action;
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGUSR1, &action, NULL);
+    return;
+}
+
+bool StopRequest::poll() {
+
+    if (world.size() == 1)
+        return stop_signal != 0;
+
+    bool stop = false;
+    if (request != MPI_REQUEST_NULL) {
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+        stop = agreed != 0;
+    }
+    local = stop_signal;
+    MPI_Iallreduce(&local, &agreed, 1, MPI_INT, MPI_MAX, world, &request);
+    return stop;
+}
+
+void StopRequest::finish() {
+
+    if (request != MPI_REQUEST_NULL)
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+    return;
+}
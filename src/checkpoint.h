@@ -0,0 +1,93 @@
+// This is a header file for the checkpoints of the cpmd run
+// A checkpoint holds what the step loop evolves and accumulates: the ions, the fake degrees (w, vw), both
+// Nose-Hoover chains, the last step done, the sample counters and the sampling accumulators (density profiles,
+// condensed ion counts, trust factor statistics). What set-up builds from the parameters (the interface and its
+// operators, which come back from the operator cache) is left out, so a run is restarted with the same command
+// line plus --restart true.
+// The file is a boost binary archive written by the first process (to a temporary file, then renamed) and
+// broadcast to all processes on restart.
+
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <csignal>
+#include <boost/serialization/string.hpp>
+#include "particle.h"
+#include "vertex.h"
+#include "thermostat.h"
+#include "trust_factor.h"
+
+class CHECKPOINT {
+
+private:
+    friend class boost::serialization::access;
+
+    template<class Archive>
+    void serialize(Archive &ar, const unsigned int version) {
+        ar & precision;
+        ar & step;
+        ar & ion;
+        ar & w;
+        ar & vw;
+        ar & wmean;
+        ar & real_bath;
+        ar & fake_bath;
+        ar & energy_samples;
+        ar & verification_samples;
+        ar & average_functional_deviation;
+        ar & density_profile_samples;
+        ar & condensed_ions;
+        ar & accumulators;
+        ar & trust_factors;
+    }
+
+public:
+
+    string precision;                       // floating point precision of the build that wrote it
+    int step;                               // last step done
+    vector<PARTICLE> ion;
+    vector<REAL> w, vw;                     // fake degrees
+    vector<double> wmean;
+    vector<THERMOSTAT> real_bath, fake_bath;
+    double energy_samples;
+    double verification_samples;
+    double average_functional_deviation;
+    double density_profile_samples;
+    vector<int> condensed_ions;             // condensedIonsPerStep
+    vector<double> accumulators;            // density profile sums of the nanoparticle
+    TrustFactors trust_factors;             // running statistics of R and R_v
+
+    CHECKPOINT() : step(0), energy_samples(0), verification_samples(0), average_functional_deviation(0),
+                   density_profile_samples(0) {}
+};
+
+// collective: the first process writes the checkpoint; false on all processes if it could not
+bool write_checkpoint(const string &, const CHECKPOINT &);
+
+// collective: the first process reads the checkpoint and broadcasts it; false on all processes if it is missing
+// or unreadable
+bool read_checkpoint(const string &, CHECKPOINT &);
+
+// SIGTERM and SIGUSR1 (as sent ahead of a batch walltime) ask the run to stop after the step in progress
+class StopRequest {
+
+public:
+
+    StopRequest() : local(0), agreed(0), request(MPI_REQUEST_NULL) {}
+
+    void install();
+
+    // once per step, on all processes: true at the same step on all of them once a stop signal has reached any.
+    // The agreement started at one step is completed at the next, so the step loop does not wait for it.
+    bool poll();
+
+    // completes the agreement in flight
+    void finish();
+
+private:
+
+    int local, agreed;
+    MPI_Request request;
+};
+
+#endif
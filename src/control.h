@@ -3,6 +3,8 @@
 #ifndef _CONTROL_H
 #define _CONTROL_H
 
+#include <string>
+
 class CONTROL
 {
   private:
@@ -41,6 +43,11 @@ class CONTROL
     int writeverify;		// write the verification files
     int writedensity; 		// write the density files
     int writedata; 		// write the data files
+    int respa_steps;		// inner (LJ) steps per time step in r-RESPA, 1 for plain velocity Verlet
+    int checkpoint;		// checkpoint written after these many steps (0: only when stopped by a signal)
+    std::string checkpoint_file;	// checkpoint of the run
+    bool restart;		// continue the run of the checkpoint file
+    bool density_analysis;	// keep the density samples for the error analysis at the end
 };
 
 #endif
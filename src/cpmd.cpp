@@ -1,37 +1,105 @@
 // This is Car-Parrinello molecular dynamics (CPMD)
 
 #include "functions.h"
+#include "checkpoint.h"
 
 extern vector<int> condensedIonsPerStep;
 
+// half kick of the ion velocities by the forces f over the time step dt, with the thermostat scaling expfac
+// (as PARTICLE::new_update_velocity; expfac = 1 gives a plain kick)
+static void kick(vector<PARTICLE> &ion, vector<VECTOR3D> &f, double dt, REAL expfac) {
+    for (unsigned int i = 0; i < ion.size(); i++)
+        ion[i].velvec = (ion[i].velvec ^ (expfac)) + (f[i] ^ (0.5 * dt * sqrt(expfac)));
+    return;
+}
+
 void cpmd(vector <PARTICLE> &ion, vector <VERTEX> &s, NanoParticle *nanoParticle, vector <THERMOSTAT> &real_bath,
           vector <THERMOSTAT> &fake_bath, CONTROL &fmdremote, CONTROL &cpmdremote) {
 
 
     // Part I : Initialize and set up
-    for (unsigned int k = 0; k < s.size(); k++) {
+    // with a direct polarization solver w is solved for in every force evaluation and is not propagated
+    bool fake_dynamics = nanoParticle->POLARIZED && !nanoParticle->solver.direct();
+    for (unsigned int k = 0; k < s.size(); k++)
         s[k].mu = cpmdremote.fakemass * s[k].a * s[k].a;                // fake degree masses assigned
-        s[k].w = s[k].wmean;                    // fake degree positions initialized
+
+    double energy_samples = 0;
+    double average_functional_deviation = 0.0;        // average deviation from the B O surface
+    double verification_samples = 0;            // number of samples used to verify C P M D evolution
+    double density_profile_samples = 0;            // number of samples used to estimate density profile
+    int first_step = 1;
+
+    if (cpmdremote.restart) {
+        // the state at the end of the step of the checkpoint
+        CHECKPOINT state;
+        string problem;
+        if (!read_checkpoint(cpmdremote.checkpoint_file, state))
+            problem = "could not be read";
+        else if (state.precision != PRECISION_NAME)
+            problem = "was written in " + state.precision + " precision";
+        else if (state.ion.size() != ion.size() || state.w.size() != s.size() ||
+                 state.real_bath.size() != real_bath.size() || state.fake_bath.size() != fake_bath.size() ||
+                 !nanoParticle->setAccumulators(state.accumulators))
+            problem = "is of a different system (ions, interface, chains or bins)";
+        if (!problem.empty()) {
+            if (world.rank() == 0)
+                cout << "The checkpoint " << cpmdremote.checkpoint_file << " " << problem << endl;
+            exit(1);
+        }
+        ion = state.ion;
+        ion_arrays.sync_positions(ion);
+        for (unsigned int k = 0; k < s.size(); k++) {
+            s[k].w = state.w[k];
+            s[k].vw = state.vw[k];
+            s[k].wmean = state.wmean[k];
+        }
+        real_bath = state.real_bath;
+        fake_bath = state.fake_bath;
+        energy_samples = state.energy_samples;
+        verification_samples = state.verification_samples;
+        average_functional_deviation = state.average_functional_deviation;
+        density_profile_samples = state.density_profile_samples;
+        nanoParticle->updateSamples(density_profile_samples);
+        condensedIonsPerStep = state.condensed_ions;
+        trust_factors = state.trust_factors;
+        first_step = state.step + 1;
+    } else {
+        for (unsigned int k = 0; k < s.size(); k++)
+            s[k].w = s[k].wmean;                    // fake degree positions initialized
+        initialize_fake_velocities(s, fake_bath, nanoParticle);
+        REAL sigma = constraint(s, ion, nanoParticle);            // constraint evaluated
+        for (unsigned int k = 0; k < s.size(); k++)
+            s[k].w = s[k].w - sigma / (s[k].a * s.size());        // constraint satisfied
+        REAL sigmadot = dotconstraint(s);                // time derivative of the constraint evaluated
+        for (unsigned int k = 0; k < s.size(); k++)
+            s[k].vw = s[k].vw - sigmadot / (s[k].a * s.size());        // time derivative of constraint satisfied
+        // particle positions initialized already, before fmd
+        initialize_particle_velocities(ion, real_bath, nanoParticle);        // particle velocities initialized
     }
-    initialize_fake_velocities(s, fake_bath, nanoParticle);
-    long double sigma = constraint(s, ion, nanoParticle);            // constraint evaluated
-    for (unsigned int k = 0; k < s.size(); k++)
-        s[k].w = s[k].w - sigma / (s[k].a * s.size());        // constraint satisfied
-    long double sigmadot = dotconstraint(s);                // time derivative of the constraint evaluated
-    for (unsigned int k = 0; k < s.size(); k++)
-        s[k].vw = s[k].vw - sigmadot / (s[k].a * s.size());        // time derivative of constraint satisfied
-    // particle positions initialized already, before fmd
-    initialize_particle_velocities(ion, real_bath, nanoParticle);        // particle velocities initialized
-    // forces on particles and fake degrees initialized
-    for_cpmd_calculate_force(s, ion, nanoParticle);
-    long double particle_ke = particle_kinetic_energy(ion);        // compute initial particle kinetic energy
-    long double fake_ke = fake_kinetic_energy(s);            // compute initial fake kinetic energy
-    double potential_energy = energy_functional(s, ion, nanoParticle);    // Compute initial potential energy
+    // r-RESPA: the electrostatic (slow) forces act once per time step, the LJ (fast) forces at respa_steps inner
+    // steps of it; the thermostats and the fake degrees move with the outer step
+    bool respa = cpmdremote.respa_steps > 1;
+    double inner_timestep = cpmdremote.timestep / cpmdremote.respa_steps;
+    vector<VECTOR3D> slow_force, fast_force;
+    double lj_energy = 0;
+    // forces on particles and fake degrees initialized, with the initial potential energy
+    double potential_energy;
+    if (respa) {
+        potential_energy = for_cpmd_calculate_force(s, ion, nanoParticle, true, false);
+        for (unsigned int i = 0; i < ion.size(); i++)
+            slow_force.push_back(ion[i].forvec);
+        potential_energy += for_cpmd_short_range_force(ion, nanoParticle, fast_force, true);
+        for (unsigned int i = 0; i < ion.size(); i++)
+            ion[i].forvec = slow_force[i] + fast_force[i];
+    } else
+        potential_energy = for_cpmd_calculate_force(s, ion, nanoParticle, true);
+    REAL particle_ke = particle_kinetic_energy(ion);        // compute initial particle kinetic energy
+    REAL fake_ke = fake_kinetic_energy(s);            // compute initial fake kinetic energy
 
     if (world.rank() == 0) {
         // Output cpmd essentials
         cout << "\n";
-        cout << "Dynamical Optimization in the simulation (CPMD) is" << " on " << endl;
+        cout << "Dynamical Optimization in the simulation (CPMD) is" << (nanoParticle->solver.direct() ? " off " : " on ") << endl;
         if (cpmdremote.verbose) {
             cout << "Mass assigned to the fake degrees " << s[0].mu << endl;
             cout << "Total induced charge on the interface " << nanoParticle->total_induced_charge(s) << endl;
@@ -57,25 +125,31 @@ void cpmd(vector <PARTICLE> &ion, vector <VERTEX> &s, NanoParticle *nanoParticle
             cout << "Verification every " << cpmdremote.verify << " steps" << endl;
             cout << "Write density profile every " << cpmdremote.writedensity << endl;
         }
+        if (cpmdremote.restart)
+            cout << "Continuing from step " << first_step - 1 << endl;
         cout << "Time step " << cpmdremote.timestep << endl;
+        if (respa)
+            cout << "r-RESPA with " << cpmdremote.respa_steps << " LJ steps of " << inner_timestep
+                 << " per time step" << endl;
     }
-    double energy_samples = 0;
-    double average_functional_deviation = 0.0;        // average deviation from the B O surface
-    double verification_samples = 0;            // number of samples used to verify C P M D evolution
     int moviestart = 0;                    // starting point of the movie
     int moviefreq = cpmdremote.freq * 10;                    // frequency of shooting the movie
 
-    double density_profile_samples = 0;            // number of samples used to estimate density profile
-
-    long double expfac_real, expfac_fake;            // exponential factors pre-computed, useful in velocity Verlet update routine
+    REAL expfac_real, expfac_fake;            // exponential factors pre-computed, useful in velocity Verlet update routine
 
     double percentage = 0, percentagePre = -1;
 
     // Output the zeroth timestep in a movie:
-    make_movie(0, ion, nanoParticle);
+    if (!cpmdremote.restart)
+        make_movie(0, ion, nanoParticle);
+
+    StopRequest stop_request;
+    stop_request.install();
 
     // Part II : Propagate
-    for (int num = 1; num <= cpmdremote.steps; num++) {
+    int steps_run = 0;          // steps of this part of the run (a restart or a signal makes it fewer than steps)
+    for (int num = first_step; num <= cpmdremote.steps; num++) {
+        steps_run++;
 
         // INTEGRATOR
         //! begins
@@ -86,17 +160,37 @@ void cpmd(vector <PARTICLE> &ion, vector <VERTEX> &s, NanoParticle *nanoParticle
         for (unsigned int j = 0; j < real_bath.size(); j++)
             real_bath[j].update_eta(cpmdremote.timestep);                    // update eta for real baths
 
+        // steps that write energies or sample the density also get the potential energy and the ion energies
+        // (for Diehl's method) from the same sweep as the forces
+        bool energy_step = (num % cpmdremote.extra_compute == 0) ||
+                           (num >= cpmdremote.hiteqm && num % cpmdremote.freq == 0);
+
         expfac_real = exp(-0.5 * cpmdremote.timestep * real_bath[0].xi);
-        // Modified velocity Verlet (with thermostat effects) for Real system
-        for (unsigned int i = 0; i < ion.size(); i++)
-            ion[i].new_update_velocity(cpmdremote.timestep, real_bath[0],
-                                       expfac_real);    // update particle velocity half time step
+        if (respa) {
+            // slow half kick (with thermostat effects), then the inner velocity Verlet steps of the LJ forces
+            kick(ion, slow_force, cpmdremote.timestep, expfac_real);
+            for (int m = 1; m <= cpmdremote.respa_steps; m++) {
+                kick(ion, fast_force, inner_timestep, 1.0);
+                for (unsigned int i = 0; i < ion.size(); i++)
+                    ion[i].update_position(inner_timestep);
+                ion_arrays.sync_positions(ion);
+                lj_energy = for_cpmd_short_range_force(ion, nanoParticle, fast_force,
+                                                       energy_step && m == cpmdremote.respa_steps);
+                kick(ion, fast_force, inner_timestep, 1.0);
+            }
+        } else {
+            // Modified velocity Verlet (with thermostat effects) for Real system
+            for (unsigned int i = 0; i < ion.size(); i++)
+                ion[i].new_update_velocity(cpmdremote.timestep, real_bath[0],
+                                           expfac_real);    // update particle velocity half time step
 
 
-        for (unsigned int i = 0; i < ion.size(); i++)
-            ion[i].update_position(cpmdremote.timestep);                    // update particle position full time step
+            for (unsigned int i = 0; i < ion.size(); i++)
+                ion[i].update_position(cpmdremote.timestep);                    // update particle position full time step
+            ion_arrays.sync_positions(ion);                    // keep the pair kernel mirror in step
+        }
 
-        if (nanoParticle->POLARIZED) {
+        if (fake_dynamics) {
             for (int j = fake_bath.size() - 1; j > -1; j--)
                 update_chain_xi(j, fake_bath, cpmdremote.timestep,
                                 fake_ke);            // update xi for fake baths in reverse order
@@ -116,15 +210,26 @@ void cpmd(vector <PARTICLE> &ion, vector <VERTEX> &s, NanoParticle *nanoParticle
         }
 
         //cout << "Pre num =" << num <<  ", pos: "<< ion[0].posvec << ", force "<<  ion[0].forvec << ", vel "<<  ion[0].velvec << endl;
-        for_cpmd_calculate_force(s, ion, nanoParticle);                    // calculate forces on ion and fake degree
+        // calculate forces on ion and fake degree
+        if (respa) {
+            potential_energy = for_cpmd_calculate_force(s, ion, nanoParticle, energy_step, false) + lj_energy;
+            for (unsigned int i = 0; i < ion.size(); i++) {
+                slow_force[i] = ion[i].forvec;
+                ion[i].forvec = slow_force[i] + fast_force[i];
+            }
+        } else
+            potential_energy = for_cpmd_calculate_force(s, ion, nanoParticle, energy_step);
         //cout << "Post num =" << num <<  ", pos: "<< ion[0].posvec << ", force "<<  ion[0].forvec << ", vel "<<  ion[0].velvec << endl;
 
-        for (unsigned int i = 0; i < ion.size(); i++)
-            ion[i].new_update_velocity(cpmdremote.timestep, real_bath[0],
-                                       expfac_real);    // update particle velocity half time step
+        if (respa)
+            kick(ion, slow_force, cpmdremote.timestep, expfac_real);    // slow half kick closing the time step
+        else
+            for (unsigned int i = 0; i < ion.size(); i++)
+                ion[i].new_update_velocity(cpmdremote.timestep, real_bath[0],
+                                           expfac_real);    // update particle velocity half time step
 
 
-        if (nanoParticle->POLARIZED) {
+        if (fake_dynamics) {
             for (unsigned int k = 0; k < s.size(); k++)
                 s[k].new_update_velocity(cpmdremote.timestep, fake_bath[0],
                                          expfac_fake);        // update fake velocity half time step
@@ -154,7 +259,7 @@ void cpmd(vector <PARTICLE> &ion, vector <VERTEX> &s, NanoParticle *nanoParticle
         // extra computations
         if (num % cpmdremote.extra_compute == 0) {
             energy_samples++;
-            compute_n_write_useful_data(num, ion, s, real_bath, fake_bath, nanoParticle);
+            compute_n_write_useful_data(num, ion, s, real_bath, fake_bath, nanoParticle, potential_energy);
             // write basic files
             write_basic_files(cpmdremote.writedata, num, ion, s, real_bath, fake_bath, nanoParticle);
         }
@@ -178,9 +283,43 @@ void cpmd(vector <PARTICLE> &ion, vector <VERTEX> &s, NanoParticle *nanoParticle
             nanoParticle->updateSamples(density_profile_samples);
             nanoParticle->updateStep(num);
             nanoParticle->compute_density_profile();
-            energy_functional(s, ion, nanoParticle);  // Assess the PE (specifically ES component for Diehl's)
+            // the ES component of the PE for Diehl's method was assessed with this step's forces
             nanoParticle->compute_effective_charge(num, condensedIonsPerStep, ion, nanoParticle, cpmdremote);
         }
+
+        // checkpoint
+        bool stop = stop_request.poll();
+        if (stop || (cpmdremote.checkpoint > 0 && num % cpmdremote.checkpoint == 0)) {
+            CHECKPOINT state;
+            state.precision = PRECISION_NAME;
+            state.step = num;
+            state.ion = ion;
+            for (unsigned int k = 0; k < s.size(); k++) {
+                state.w.push_back(s[k].w);
+                state.vw.push_back(s[k].vw);
+                state.wmean.push_back(s[k].wmean);
+            }
+            state.real_bath = real_bath;
+            state.fake_bath = fake_bath;
+            state.energy_samples = energy_samples;
+            state.verification_samples = verification_samples;
+            state.average_functional_deviation = average_functional_deviation;
+            state.density_profile_samples = density_profile_samples;
+            state.condensed_ions = condensedIonsPerStep;
+            state.trust_factors = trust_factors;
+            nanoParticle->getAccumulators(state.accumulators);
+            series.flush();
+            output.flush();             // the output files hold the steps of the checkpoint
+            bool written = write_checkpoint(cpmdremote.checkpoint_file, state);
+            if (world.rank() == 0 && (!written || stop))
+                cout << "\nCheckpoint of step " << num << (written ? " written to " : " could not be written to ")
+                     << cpmdremote.checkpoint_file << endl;
+        }
+        if (stop) {
+            if (world.rank() == 0)
+                cout << "Stopped by a signal after step " << num << "; continue with --restart true" << endl;
+            break;
+        }
         //percentage calculation
         if (world.rank() == 0)
         {
@@ -192,6 +331,7 @@ void cpmd(vector <PARTICLE> &ion, vector <VERTEX> &s, NanoParticle *nanoParticle
             //percentage output
             if(percentage!=percentagePre)
             {
+                series.flush();         // the series so far can be read (plotted) during the run
                 if(!cpmdremote.verbose)
                 {
                     int progressBarVal=(int) (percentage+0.5);
@@ -208,6 +348,14 @@ void cpmd(vector <PARTICLE> &ion, vector <VERTEX> &s, NanoParticle *nanoParticle
 
     }
 
+    stop_request.finish();
+    series.flush();
+    output.stop();
+
+    // error analysis of the density samples
+    if (world.rank() == 0 && cpmdremote.density_analysis)
+        analyse_density_samples(nanoParticle, cpmdremote);
+
     // Part III : Analysis
     // Final density profile
     nanoParticle->compute_final_density_profile();
@@ -218,14 +366,40 @@ void cpmd(vector <PARTICLE> &ion, vector <VERTEX> &s, NanoParticle *nanoParticle
     ofstream final_configuration("outfiles/final_configuration.dat");
     for (unsigned int i = 0; i < ion.size(); i++)
         final_configuration << ion[i].posvec << endl;
+    // time the ranks spent computing while the interface exchanges of the force routine were in flight, and
+    // waiting for them after that, averaged over the ranks (the time the transfers themselves took is not known)
+    double exchange_times[2] = {mesh_exchange.computing_time, mesh_exchange.waiting_time}, total_times[2];
+    if (world.size() > 1)
+        all_reduce(world, exchange_times, 2, total_times, std::plus<double>());
+
     if (world.rank() == 0 && cpmdremote.verbose) {
         cout << "Number of samples used to compute energy" << setw(10) << energy_samples << endl;
         cout << "Number of samples used to get density profile, effective charge" << setw(10) << density_profile_samples << endl;
+        cout << "Number of LJ neighbor list builds" << setw(10) << neighbor_list.builds << endl;
         if (nanoParticle->POLARIZED)
             cout << "Number of samples used to verify on the fly results" << setw(10) << verification_samples << endl;
         if (nanoParticle->POLARIZED)
             cout << "Average deviation of the functional from the BO surface" << setw(15)
                  << average_functional_deviation / verification_samples << endl;
+        if (nanoParticle->POLARIZED && nanoParticle->solver.mode == SOLVER_PCG)
+            cout << "Average pcg iterations per step" << setw(15)
+                 << double(nanoParticle->solver.total_iterations) / nanoParticle->solver.solves << endl;
+        if (nanoParticle->POLARIZED && nanoParticle->solver.mode == SOLVER_PCG)
+            cout << "Pcg solves stopped at the iteration cap short of the tolerance" << setw(10)
+                 << nanoParticle->solver.unconverged << endl;
+        if (output.queued > 0) {
+            cout << "Output records queued for the writer thread" << setw(10) << output.queued << endl;
+            cout << "Largest output queue depth" << setw(10) << output.largest_depth << " of " << output.depth()
+                 << endl;
+            cout << "Output records late (queue full), dropped (not written)" << setw(10) << output.late
+                 << setw(10) << output.dropped << endl;
+        }
+        if (nanoParticle->POLARIZED && world.size() > 1) {
+            cout << "Time per step computing while the interface exchanges were in flight (ms)" << setw(15)
+                 << 1000 * total_times[0] / world.size() / max(steps_run, 1) << endl;
+            cout << "Time per step blocked waiting for the interface exchanges (ms)" << setw(15)
+                 << 1000 * total_times[1] / world.size() / max(steps_run, 1) << endl;
+        }
     }
     return;
 }
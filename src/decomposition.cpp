@@ -0,0 +1,133 @@
+// This file contains the 1d and 2d decompositions of the ion - vertex interaction work
+
+#include "decomposition.h"
+#include "mpi_utility.h"
+
+bool Decomposition::set_mode(const string &name) {
+    if (name == "1d")
+        mode = DECOMPOSITION_1D;
+    else if (name == "2d")
+        mode = DECOMPOSITION_2D;
+    else
+        return false;
+    return true;
+}
+
+const char *Decomposition::mode_name() const {
+    return mode == DECOMPOSITION_2D ? "2d" : "1d";
+}
+
+void Decomposition::set_up(const mpi::communicator &comm) {
+
+    world_rank = comm.rank();
+    unsigned int processes = comm.size();
+    if (processes == 1)
+        mode = DECOMPOSITION_1D;
+    if (mode == DECOMPOSITION_1D) {
+        rows = 1;
+        columns = processes;
+        row = 0;
+        column = world_rank;
+        return;
+    }
+
+    // the largest divisor of the number of processes not above its square root
+    rows = 1;
+    for (unsigned int d = 1; d * d <= processes; d++)
+        if (processes % d == 0)
+            rows = d;
+    columns = processes / rows;
+    row = world_rank / columns;
+    column = world_rank % columns;
+    row_comm = comm.split(row, column);
+    column_comm = comm.split(column, row);
+    return;
+}
+
+void Decomposition::set_blocks(unsigned int mesh_lower, unsigned int mesh_upper, unsigned int ions_lower,
+                               unsigned int ions_upper) {
+
+    if (mode == DECOMPOSITION_1D) {
+        vertex_lower = mesh_lower;
+        vertex_upper = mesh_upper;
+        ion_lower = ions_lower;
+        ion_upper = ions_upper;
+        return;
+    }
+
+    vector<unsigned int> lowers, uppers;
+    all_gather(row_comm, mesh_lower, lowers);
+    all_gather(row_comm, mesh_upper, uppers);
+    vertex_lower = lowers.front();
+    vertex_upper = uppers.back();
+    vertex_counts.resize(columns);
+    for (unsigned int c = 0; c < columns; c++)
+        vertex_counts[c] = uppers[c] + 1 - lowers[c];
+
+    all_gather(column_comm, ions_lower, lowers);
+    all_gather(column_comm, ions_upper, uppers);
+    ion_lower = lowers.front();
+    ion_upper = uppers.back();
+    ion_counts.resize(rows);
+    for (unsigned int r = 0; r < rows; r++)
+        ion_counts[r] = uppers[r] + 1 - lowers[r];
+    return;
+}
+
+void Decomposition::vertex_sums(const vector<VERTEX> &s, const vector<PARTICLE> &ion, double em, vector<REAL> &g3,
+                                vector<REAL> &g4, vector<REAL> &gq) {
+
+    if (mode == DECOMPOSITION_1D) {
+        ion_vertex_vertex_sums(s, ion, lowerBoundMesh, upperBoundMesh, 0, ion.size() - 1, em, g3, g4, gq);
+        return;
+    }
+
+    // the tile of this process, for all vertices of the row block
+    unsigned int n = vertex_upper + 1 - vertex_lower;
+    vector<REAL> t3(n), t4(n), tq(n);
+    ion_vertex_vertex_sums(s, ion, vertex_lower, vertex_upper, ion_lower, ion_upper, em, t3, t4, tq);
+
+    // packed by the process of the row that owns the vertices: its g3, g4 and gq in turn
+    send.resize(3 * n);
+    vector<int> counts(columns);
+    for (unsigned int c = 0, offset = 0; c < columns; offset += vertex_counts[c], c++) {
+        unsigned int m = vertex_counts[c];
+        copy(t3.begin() + offset, t3.begin() + offset + m, send.begin() + 3 * offset);
+        copy(t4.begin() + offset, t4.begin() + offset + m, send.begin() + 3 * offset + m);
+        copy(tq.begin() + offset, tq.begin() + offset + m, send.begin() + 3 * offset + 2 * m);
+        counts[c] = 3 * m;
+    }
+    unsigned int own = vertex_counts[column];
+    receive.resize(3 * own);
+    MPI_Datatype type = mpi::get_mpi_datatype<REAL>(REAL());
+    MPI_Reduce_scatter(&send[0], &receive[0], &counts[0], type, MPI_SUM, row_comm);
+    copy(receive.begin(), receive.begin() + own, g3.begin());
+    copy(receive.begin() + own, receive.begin() + 2 * own, g4.begin());
+    copy(receive.begin() + 2 * own, receive.end(), gq.begin());
+    return;
+}
+
+void Decomposition::ion_sums(const vector<VERTEX> &s, const vector<PARTICLE> &ion, const ION_VERTEX_WEIGHTS &w,
+                             bool with_energy, vector<ION_VERTEX_SUMS> &out) {
+
+    if (mode == DECOMPOSITION_1D) {
+        ion_vertex_ion_sums(s, ion, lowerBoundIons, upperBoundIons, 0, s.size() - 1, w, with_energy, out);
+        return;
+    }
+
+    // the tile of this process, for all ions of the column block; the blocks of the processes of the column
+    // follow each other in it
+    static_assert(sizeof(ION_VERTEX_SUMS) % sizeof(REAL) == 0, "ION_VERTEX_SUMS is reduced as REAL values");
+    const int values = sizeof(ION_VERTEX_SUMS) / sizeof(REAL);
+    vector<ION_VERTEX_SUMS> tile;
+    ion_vertex_ion_sums(s, ion, ion_lower, ion_upper, vertex_lower, vertex_upper, w, with_energy, tile);
+
+    vector<int> counts(rows);
+    for (unsigned int r = 0; r < rows; r++)
+        counts[r] = ion_counts[r] * values;
+    out.resize(ion_counts[row]);
+    MPI_Datatype type = mpi::get_mpi_datatype<REAL>(REAL());
+    MPI_Reduce_scatter(reinterpret_cast<REAL *>(&tile[0]), reinterpret_cast<REAL *>(&out[0]), &counts[0], type,
+                       MPI_SUM, column_comm);
+    return;
+}
@@ -0,0 +1,69 @@
+// This is a header file for the decomposition of the ion - vertex interaction work over the processes
+// 1d : each process sums over all ions for its vertices (lowerBoundMesh..upperBoundMesh) and over all vertices
+//      for its ions (lowerBoundIons..upperBoundIons)
+// 2d : the processes form a rows x columns grid over the vertex x ion interaction matrix. The vertex blocks
+//      of the processes of a grid row make up one row block, the ion blocks of a grid column one column block
+//      (the ion blocks are numbered down the columns for that). Each process sums its tile, row block x column
+//      block, and the partial sums are reduce-scattered over the row (vertex sums) or the column (ion sums)
+//      sub-communicator, so every process again ends up with the sums of its own vertices and ions.
+//      The tiles stay large as the processes outnumber min(N_s, N_ion) / threads.
+
+#ifndef _DECOMPOSITION_H
+#define _DECOMPOSITION_H
+
+#include "ion_vertex.h"
+
+enum DECOMPOSITION_MODE {
+    DECOMPOSITION_1D = 0,
+    DECOMPOSITION_2D = 1
+};
+
+class Decomposition {
+
+public:
+
+    DECOMPOSITION_MODE mode;
+    unsigned int rows, columns;             // process grid
+    unsigned int row, column;               // grid position of this process
+
+    Decomposition() : mode(DECOMPOSITION_1D), rows(1), columns(1), row(0), column(0), world_rank(0),
+                      vertex_lower(0), vertex_upper(0), ion_lower(0), ion_upper(0) {}
+
+    // false if name is not one of 1d, 2d
+    bool set_mode(const string &name);
+
+    const char *mode_name() const;
+
+    // the process grid (as square as the number of processes allows) and its row and column communicators
+    void set_up(const mpi::communicator &);
+
+    // position of this process in the partition of the ions
+    unsigned int ion_position() const {
+        return mode == DECOMPOSITION_2D ? column * rows + row : world_rank;
+    }
+
+    // the row and column blocks, from the vertex and ion blocks of all processes
+    void set_blocks(unsigned int mesh_lower, unsigned int mesh_upper, unsigned int ions_lower,
+                    unsigned int ions_upper);
+
+    // ion_vertex_vertex_sums for the vertices lowerBoundMesh..upperBoundMesh over all ions
+    void vertex_sums(const vector<VERTEX> &, const vector<PARTICLE> &, double em, vector<REAL> &g3,
+                     vector<REAL> &g4, vector<REAL> &gq);
+
+    // ion_vertex_ion_sums for the ions lowerBoundIons..upperBoundIons over all vertices
+    void ion_sums(const vector<VERTEX> &, const vector<PARTICLE> &, const ION_VERTEX_WEIGHTS &, bool with_energy,
+                  vector<ION_VERTEX_SUMS> &);
+
+private:
+
+    unsigned int world_rank;
+    mpi::communicator row_comm, column_comm;
+    unsigned int vertex_lower, vertex_upper;         // row block
+    unsigned int ion_lower, ion_upper;               // column block
+    vector<int> vertex_counts, ion_counts;          // blocks of the processes of the row and of the column
+    vector<REAL> send, receive;
+};
+
+extern Decomposition decomposition;
+
+#endif
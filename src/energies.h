@@ -8,21 +8,21 @@
 #include "thermostat.h"
 #include "functions.h"
 
-inline long double fake_kinetic_energy(vector<VERTEX>& s)
+inline REAL fake_kinetic_energy(vector<VERTEX>& s)
 {
   for (unsigned int k = 0; k < s.size(); k++)
     s[k].kinetic_energy();
-  long double kinetic_energy = 0.0;
+  REAL kinetic_energy = 0.0;
   for (unsigned int k = 0; k < s.size(); k++)
     kinetic_energy += s[k].ke;  
   return kinetic_energy;
 }
 
-inline long double particle_kinetic_energy(vector<PARTICLE>& ion)
+inline REAL particle_kinetic_energy(vector<PARTICLE>& ion)
 {
   for (unsigned int i = 0; i < ion.size(); i++)
     ion[i].kinetic_energy();
-  long double kinetic_energy = 0.0;
+  REAL kinetic_energy = 0.0;
   for (unsigned int i = 0; i < ion.size(); i++)
     kinetic_energy += ion[i].ke;
   return kinetic_energy;
@@ -0,0 +1,73 @@
+// This file contains the set up of the packed exchange of the per-process blocks
+
+#include "exchange.h"
+
+void Exchange::set_up(const mpi::communicator &c, unsigned int lower, unsigned int upper) {
+
+    comm = c;
+    unsigned int count = upper + 1 - lower;
+    if (comm.size() > 1) {
+        mpi::all_gather(comm, lower, lowers);
+        mpi::all_gather(comm, count, counts);
+    } else {
+        lowers.assign(1, lower);
+        counts.assign(1, count);
+    }
+    total = 0;
+    for (unsigned int p = 0; p < counts.size(); p++)
+        total += counts[p];
+    layout_values = 0;
+    return;
+}
+
+void Exchange::progress() {
+
+    if (request != MPI_REQUEST_NULL) {
+        int done;
+        MPI_Test(&request, &done, MPI_STATUS_IGNORE);
+    }
+    return;
+}
+
+void Exchange::finish() {
+
+    if (comm.size() == 1)
+        return;
+    double wait_start = MPI_Wtime();
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+    double wait_end = MPI_Wtime();
+    computing_time += wait_start - start_time;
+    waiting_time += wait_end - wait_start;
+    unpack();
+    return;
+}
+
+void Exchange::unpack() {
+
+    if (pending_fields == 1)
+        return;
+    size_t field_bytes = pending_bytes * pending_fields;
+    for (unsigned int p = 0; p < counts.size(); p++) {
+        const char *from = &receive[lowers[p] * field_bytes];
+        size_t length = counts[p] * pending_bytes;
+        for (unsigned int f = 0; f < pending_fields; f++)
+            copy(from + f * length, from + (f + 1) * length, pending_full[f] + lowers[p] * pending_bytes);
+    }
+    return;
+}
+
+// counts and displacements (in values) of the rank blocks for values_per_item values per item
+void Exchange::pack_layout(unsigned int values_per_item) {
+
+    if (layout_values == values_per_item)
+        return;
+    layout_values = values_per_item;
+    unsigned int p = counts.size();
+    packed_counts.resize(p);
+    packed_displacements.resize(p);
+    for (unsigned int n = 0; n < p; n++) {
+        packed_counts[n] = counts[n] * values_per_item;
+        packed_displacements[n] = lowers[n] * values_per_item;
+    }
+    return;
+}
@@ -0,0 +1,170 @@
+// This is a header file for the packed exchange of the per-process blocks of the vertices or the ions
+// Each process owns a contiguous block lower..upper of the items, of any length (no padding of the last block).
+// The blocks of several arrays of one phase are packed into one buffer and exchanged in a single MPI_Allgatherv
+// on the native MPI type (no serialization); the pack buffers are kept from call to call.
+// An exchange can also be started without blocking (MPI_Iallgatherv) and finished once the work that does not
+// need its result is done; the time spent computing in between and then blocked waiting is accounted for.
+
+#ifndef _EXCHANGE_H
+#define _EXCHANGE_H
+
+#include "utility.h"
+
+class Exchange {
+
+public:
+
+    double computing_time;          // time between the start and the finish of the nonblocking exchanges
+    double waiting_time;            // time blocked in finish
+    unsigned long started;          // number of nonblocking exchanges
+
+    Exchange() : computing_time(0), waiting_time(0), started(0), total(0), layout_values(0), pending_fields(0),
+                 pending_bytes(0), request(MPI_REQUEST_NULL), start_time(0) {}
+
+    // the blocks of all processes of the communicator (one all_gather of the bounds)
+    void set_up(const mpi::communicator &, unsigned int lower, unsigned int upper);
+
+    // number of items over all processes
+    unsigned int size() const {
+        return total;
+    }
+
+    // block of process p
+    unsigned int lower(int p) const {
+        return lowers[p];
+    }
+
+    unsigned int count(int p) const {
+        return counts[p];
+    }
+
+    // the local blocks (width values per item) of the arrays local[0 .. fields) are gathered, in one collective,
+    // into the arrays full[0 .. fields) of size() * width values each
+    template<typename T>
+    void all_gather(const T *const *local, T *const *full, unsigned int fields, unsigned int width = 1);
+
+    template<typename T>
+    void all_gather(const T *local, T *full, unsigned int width = 1) {
+        all_gather(&local, &full, 1, width);
+    }
+
+    // the same exchange, started without blocking: local must not change and full is not filled until finish();
+    // one exchange can be in flight at a time
+    template<typename T>
+    void start_all_gather(const T *const *local, T *const *full, unsigned int fields, unsigned int width = 1);
+
+    template<typename T>
+    void start_all_gather(const T *local, T *full, unsigned int width = 1) {
+        start_all_gather(&local, &full, 1, width);
+    }
+
+    // lets the library advance the exchange in flight (for a long stretch of independent work); called often by
+    // the master thread of the ion loops run while the interface exchanges of the force routine are in flight
+    void progress();
+
+    void finish();
+
+    // the local blocks of one array collected on the root process only
+    template<typename T>
+    void gather(const T *local, T *full, unsigned int width, int root);
+
+private:
+
+    mpi::communicator comm;
+    unsigned int total;
+    vector<unsigned int> lowers, counts;            // block of each process
+    unsigned int layout_values;                     // values per item of packed_counts, packed_displacements
+    vector<int> packed_counts, packed_displacements;
+    vector<char> send, receive;
+
+    // exchange in flight (or packed and waiting to be unpacked)
+    unsigned int pending_fields;
+    size_t pending_bytes;                           // bytes per item of one field
+    vector<char *> pending_full;
+    MPI_Request request;
+    double start_time;
+
+    void pack_layout(unsigned int values_per_item);
+
+    // packs the local blocks into send (unless there is one field) and sets the pending exchange
+    template<typename T>
+    const T *pack(const T *const *local, T *const *full, unsigned int fields, unsigned int width);
+
+    // copies the packed blocks of receive into the full arrays of the pending exchange
+    void unpack();
+};
+
+template<typename T>
+const T *Exchange::pack(const T *const *local, T *const *full, unsigned int fields, unsigned int width) {
+
+    size_t block = (size_t) counts[comm.rank()] * width;
+    pack_layout(fields * width);
+    pending_fields = fields;
+    pending_bytes = width * sizeof(T);
+    pending_full.resize(fields);
+    for (unsigned int f = 0; f < fields; f++)
+        pending_full[f] = reinterpret_cast<char *>(full[f]);
+    if (fields == 1)
+        return local[0];
+
+    // rank blocks of the packed buffer hold the blocks of each field in turn
+    send.resize(fields * block * sizeof(T));
+    receive.resize((size_t) total * fields * width * sizeof(T));
+    T *packed = reinterpret_cast<T *>(&send[0]);
+    for (unsigned int f = 0; f < fields; f++)
+        copy(local[f], local[f] + block, packed + f * block);
+    return packed;
+}
+
+template<typename T>
+void Exchange::all_gather(const T *const *local, T *const *full, unsigned int fields, unsigned int width) {
+
+    size_t block = (size_t) counts[comm.rank()] * width;
+    if (comm.size() == 1) {
+        for (unsigned int f = 0; f < fields; f++)
+            copy(local[f], local[f] + block, full[f]);
+        return;
+    }
+
+    MPI_Datatype type = mpi::get_mpi_datatype<T>(T());
+    const T *packed = pack(local, full, fields, width);
+    T *all = fields == 1 ? full[0] : reinterpret_cast<T *>(&receive[0]);
+    MPI_Allgatherv(const_cast<T *>(packed), (int) (fields * block), type, all, &packed_counts[0],
+                   &packed_displacements[0], type, comm);
+    unpack();
+}
+
+template<typename T>
+void Exchange::start_all_gather(const T *const *local, T *const *full, unsigned int fields, unsigned int width) {
+
+    size_t block = (size_t) counts[comm.rank()] * width;
+    if (comm.size() == 1) {
+        for (unsigned int f = 0; f < fields; f++)
+            copy(local[f], local[f] + block, full[f]);
+        return;
+    }
+
+    MPI_Datatype type = mpi::get_mpi_datatype<T>(T());
+    const T *packed = pack(local, full, fields, width);
+    T *all = fields == 1 ? full[0] : reinterpret_cast<T *>(&receive[0]);
+    MPI_Iallgatherv(const_cast<T *>(packed), (int) (fields * block), type, all, &packed_counts[0],
+                    &packed_displacements[0], type, comm, &request);
+    start_time = MPI_Wtime();
+    started++;
+}
+
+template<typename T>
+void Exchange::gather(const T *local, T *full, unsigned int width, int root) {
+
+    size_t block = (size_t) counts[comm.rank()] * width;
+    if (comm.size() == 1) {
+        copy(local, local + block, full);
+        return;
+    }
+    MPI_Datatype type = mpi::get_mpi_datatype<T>(T());
+    pack_layout(width);
+    MPI_Gatherv(const_cast<T *>(local), (int) block, type, full, &packed_counts[0], &packed_displacements[0], type,
+                root, comm);
+}
+
+#endif
@@ -12,14 +12,14 @@ void fmd(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle *nanoParticle, C
         s[k].w = 0.0;                                // Initialize fake degree value		(unconstrained)
         s[k].vw = 0.0;                                // Initialize fake degree velocity	(unconstrained)
     }
-    long double sigma = constraint(s, ion, nanoParticle);
+    REAL sigma = constraint(s, ion, nanoParticle);
     for (unsigned int k = 0; k < s.size(); k++)
         s[k].w = s[k].w - sigma / (s[k].a * s.size());                // Satisfy constraint
-    long double sigmadot = dotconstraint(s);
+    REAL sigmadot = dotconstraint(s);
     for (unsigned int k = 0; k < s.size(); k++)
         s[k].vw = s[k].vw - sigmadot / (s[k].a * s.size());                // Satisfy time derivative of the constraint
     for_fmd_calculate_force(s, ion, nanoParticle);                // Compute initial force
-    long double kinetic_energy = fake_kinetic_energy(s);                // Compute initial kinetic energy
+    REAL kinetic_energy = fake_kinetic_energy(s);                // Compute initial kinetic energy
     double potential_energy = energy_functional(s, ion, nanoParticle);    // Compute initial potential energy
     fmdremote.annealfreq = 1000;
     // create fmd output files
@@ -96,7 +96,7 @@ void fmd(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle *nanoParticle, C
 
         // additional computations (turn off for faster simulations)
         if (num % fmdremote.extra_compute == 0) {
-            long double kinetic_energy = fake_kinetic_energy(s);
+            REAL kinetic_energy = fake_kinetic_energy(s);
             double potential_energy = energy_functional(s, ion, nanoParticle);
             double extended_energy = kinetic_energy + potential_energy;
             fmde << num << "  " << extended_energy << "  " << kinetic_energy << "  " << potential_energy << endl;
@@ -7,10 +7,18 @@
 #include "vertex.h"
 #include "particle.h"
 #include "functions.h"
+#include "decomposition.h"
 
 void for_fmd_calculate_force(vector<VERTEX> &, vector<PARTICLE> &, NanoParticle *);
 
-void
-for_cpmd_calculate_force(vector<VERTEX> &, vector<PARTICLE> &, NanoParticle *);
+// forces on the ions and fake degrees; with_energy = true also returns the potential energy and sets the
+// electrostatic energy of each ion, sharing the sums of the force evaluation (0 is returned otherwise);
+// with_short_range = false gives the slow forces of r-RESPA, without the LJ terms
+double
+for_cpmd_calculate_force(vector<VERTEX> &, vector<PARTICLE> &, NanoParticle *, bool with_energy = false,
+                         bool with_short_range = true);
+
+// the fast forces of r-RESPA: LJ forces on all ions (ion.size() of them in lj); with_energy also returns their energy
+double for_cpmd_short_range_force(vector<PARTICLE> &, NanoParticle *, vector<VECTOR3D> &lj, bool with_energy = false);
 
 #endif 
@@ -1,6 +1,7 @@
 // This file contains the routines 
 
 #include "functions.h"
+#include <algorithm>
 
 // overload out
 ostream &operator<<(ostream &os, VECTOR3D vec) {
@@ -75,21 +76,10 @@ void initialize_fake_velocities(vector<VERTEX> &s, vector<THERMOSTAT> &fake_bath
 
 // compute additional quantities
 void compute_n_write_useful_data(int cpmdstep, vector<PARTICLE> &ion, vector<VERTEX> &s, vector<THERMOSTAT> &real_bath,
-                                 vector<THERMOSTAT> &fake_bath, NanoParticle *nanoParticle) {
+                                 vector<THERMOSTAT> &fake_bath, NanoParticle *nanoParticle, double potential_energy) {
 
 
-    double potential_energy = energy_functional(s, ion, nanoParticle);
-
     if (world.rank() == 0) {
-        ofstream list_tic("outfiles/total_induced_charge.dat", ios::app);
-        ofstream list_temperature("outfiles/temperature.dat", ios::app);
-        ofstream list_energy("outfiles/energy.dat", ios::app);
-        list_temperature << cpmdstep << setw(15) << 2 * particle_kinetic_energy(ion) / (real_bath[0].dof * kB)
-                         << setw(15)
-                         << real_bath[0].T << setw(15) << 2 * fake_kinetic_energy(s) / (fake_bath[0].dof * kB)
-                         << setw(15)
-                         << fake_bath[0].T << endl;
-        list_tic << cpmdstep << setw(15) << nanoParticle->total_induced_charge(s) << endl;
         double fake_ke = fake_kinetic_energy(s);
         double particle_ke = particle_kinetic_energy(ion);
         double real_bath_ke = bath_kinetic_energy(real_bath);
@@ -98,21 +88,61 @@ void compute_n_write_useful_data(int cpmdstep, vector<PARTICLE> &ion, vector<VER
         double fake_bath_pe = bath_potential_energy(fake_bath);
         double extenergy =
                 fake_ke + particle_ke + potential_energy + real_bath_ke + real_bath_pe + fake_bath_ke + fake_bath_pe;
-        list_energy << cpmdstep << setw(15) << extenergy << setw(15) << particle_ke << setw(15) << potential_energy
-                    << setw(15) << particle_ke + potential_energy + real_bath_ke + real_bath_pe << setw(15) << fake_ke
-                    << setw(15) << fake_ke + fake_bath_ke + fake_bath_pe << setw(15) << real_bath_ke << setw(15)
-                    << real_bath_pe << setw(15) << fake_bath_ke << setw(15) << fake_bath_pe << endl;
+        double total_induced_charge = nanoParticle->total_induced_charge(s);
+
+        vector<double> temperature(4), energy(10);
+        temperature[0] = 2 * particle_ke / (real_bath[0].dof * kB);
+        temperature[1] = real_bath[0].T;
+        temperature[2] = 2 * fake_ke / (fake_bath[0].dof * kB);
+        temperature[3] = fake_bath[0].T;
+        energy[0] = extenergy;
+        energy[1] = particle_ke;
+        energy[2] = potential_energy;
+        energy[3] = particle_ke + potential_energy + real_bath_ke + real_bath_pe;
+        energy[4] = fake_ke;
+        energy[5] = fake_ke + fake_bath_ke + fake_bath_pe;
+        energy[6] = real_bath_ke;
+        energy[7] = real_bath_pe;
+        energy[8] = fake_bath_ke;
+        energy[9] = fake_bath_pe;
+        series.temperature.append(cpmdstep, temperature);
+        series.induced_charge.append(cpmdstep, vector<double>(1, total_induced_charge));
+        series.energy.append(cpmdstep, energy);
+        trust_factors.add(extenergy, particle_ke, fake_ke);
+        vector<double> trust(2);
+        trust[0] = trust_factors.R();
+        trust[1] = trust_factors.R_v();
+        series.trust_factor.append(cpmdstep, trust);
+
+        if (series.text) {
+            ostringstream list_tic, list_temperature, list_energy;
+            list_temperature << cpmdstep;
+            for (unsigned int c = 0; c < temperature.size(); c++)
+                list_temperature << setw(15) << temperature[c];
+            list_temperature << endl;
+            list_tic << cpmdstep << setw(15) << total_induced_charge << endl;
+            list_energy << cpmdstep;
+            for (unsigned int c = 0; c < energy.size(); c++)
+                list_energy << setw(15) << energy[c];
+            list_energy << endl;
+            output.append("outfiles/temperature.dat", list_temperature.str());
+            output.append("outfiles/total_induced_charge.dat", list_tic.str());
+            output.append("outfiles/energy.dat", list_energy.str());
+            ostringstream list_trust;
+            list_trust << cpmdstep << setw(15) << trust[0] << setw(15) << trust[1] << endl;
+            output.append("outfiles/trust_factor.dat", list_trust.str());
+        }
     }
 }
 
 // verify on the fly properties with exact
+// s is not modified; fmd runs on a copy of the O(N) vertex state (the operators are shared through nanoParticle)
 double
-verify_with_FMD(int cpmdstep, vector<VERTEX> s, vector<PARTICLE> &ion, NanoParticle *nanoParticle, CONTROL &fmdremote,
+verify_with_FMD(int cpmdstep, vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle *nanoParticle, CONTROL &fmdremote,
                 CONTROL &cpmdremote) {
 
 
-    vector<VERTEX> exact_s;
-    exact_s = s;
+    vector<VERTEX> exact_s(s);
     fmdremote.verify = cpmdstep;
     fmd(exact_s, ion, nanoParticle, fmdremote, cpmdremote);
     for (unsigned int k = 0; k < s.size(); k++)
@@ -125,28 +155,39 @@ verify_with_FMD(int cpmdstep, vector<VERTEX> s, vector<PARTICLE> &ion, NanoParti
                 functional_deviation + 100 * (on_the_fly_functional - exact_functional) / exact_functional;
     functional_deviation = functional_deviation / s.size();
     if (world.rank() == 0) {
-        ofstream track_density("outfiles/track_density.dat", ios::app);
-        ofstream track_functional("outfiles/track_functional.dat", ios::app);
-        ofstream track_functional_deviation("outfiles/track_deviation.dat", ios::app);
-        track_density << cpmdstep << setw(15) << s[0].w << setw(15) << exact_s[0].w << endl;
-        track_functional << cpmdstep << setw(15) << on_the_fly_functional << setw(15) << exact_functional << endl;
-        track_functional_deviation << cpmdstep << setw(15) << functional_deviation << endl;
+        vector<double> density(2), functional(2);
+        density[0] = s[0].w;
+        density[1] = exact_s[0].w;
+        functional[0] = on_the_fly_functional;
+        functional[1] = exact_functional;
+        series.track_density.append(cpmdstep, density);
+        series.track_functional.append(cpmdstep, functional);
+        series.track_deviation.append(cpmdstep, vector<double>(1, functional_deviation));
+        if (series.text) {
+            ostringstream track_density, track_functional, track_functional_deviation;
+            track_density << cpmdstep << setw(15) << s[0].w << setw(15) << exact_s[0].w << endl;
+            track_functional << cpmdstep << setw(15) << on_the_fly_functional << setw(15) << exact_functional << endl;
+            track_functional_deviation << cpmdstep << setw(15) << functional_deviation << endl;
+            output.append("outfiles/track_density.dat", track_density.str());
+            output.append("outfiles/track_functional.dat", track_functional.str());
+            output.append("outfiles/track_deviation.dat", track_functional_deviation.str());
+        }
 
         // write exact induced density
         char data[200];
         sprintf(data, "verifiles/_ind_%.06d.dat", cpmdstep);
-        ofstream out_correct_ind;
-        out_correct_ind.open(data);
+        ostringstream out_correct_ind;
         for (unsigned int k = 0; k < s.size(); k++)
             out_correct_ind << k + 1 << " " << exact_s[k].theta << " " << exact_s[k].phi << " " << exact_s[k].wmean
                             << endl;
+        output.write(data, out_correct_ind.str());
 
         // write cpmd computed induced density
         sprintf(data, "computedfiles/_cpmdind_%.06d.dat", cpmdstep);
-        ofstream out_cpmd_ind;
-        out_cpmd_ind.open(data);
+        ostringstream out_cpmd_ind;
         for (unsigned int k = 0; k < s.size(); k++)
             out_cpmd_ind << k + 1 << " " << s[k].theta << " " << s[k].phi << " " << s[k].w << endl;
+        output.write(data, out_cpmd_ind.str());
     }
     return functional_deviation;
 }
@@ -155,8 +196,18 @@ verify_with_FMD(int cpmdstep, vector<VERTEX> s, vector<PARTICLE> &ion, NanoParti
 void make_movie(int num, vector<PARTICLE> &ion, NanoParticle *nanoParticle) {
 
 
-    if (world.rank() == 0) {
-        ofstream outdump("outfiles/p.lammpstrj", ios::app);
+    if (world.rank() == 0 && trajectory.active()) {
+        vector<double> xyz(3 * ion.size()), es(ion.size()), ke(ion.size());
+        for (unsigned int i = 0; i < ion.size(); i++) {
+            xyz[3 * i] = ion[i].posvec.x;
+            xyz[3 * i + 1] = ion[i].posvec.y;
+            xyz[3 * i + 2] = ion[i].posvec.z;
+            es[i] = ion[i].electrostaticPE;
+            ke[i] = ion[i].ke;
+        }
+        trajectory.write_frame(num - 1, xyz, es, ke);
+    } else if (world.rank() == 0) {
+        ostringstream outdump;
         outdump << "ITEM: TIMESTEP" << endl;
         outdump << num - 1 << endl;
         outdump << "ITEM: NUMBER OF ATOMS" << endl;
@@ -176,67 +227,22 @@ void make_movie(int num, vector<PARTICLE> &ion, NanoParticle *nanoParticle) {
                     << ion[i].posvec.y << "\t" << setw(8) << ion[i].posvec.z << "\t" << ion[i].electrostaticPE
                     << "\t" << ion[i].ke << endl;
         }
-        outdump.close();
+        output.append("outfiles/p.lammpstrj", outdump.str());
     }
     return;
 }
 
-// compute MD trust factor R
+// compute MD trust factor R (from the running statistics of the extra computation steps)
 double compute_MD_trust_factor_R(int hiteqm) {
 
 
-    char filename[200];
-    sprintf(filename, "outfiles/energy.dat");
-    ifstream in(filename, ios::in);
-    if (!in) {
-        if (world.rank() == 0)
-            cout << "File could not be opened" << endl;
-        return 0;
-    }
-
-    int col1;
-    double col2, col3, col4, col5, col6, col7, col8, col9, col10, col11;
-    vector<double> ext, ke, pe, fake, real;
-    while (in >> col1 >> col2 >> col3 >> col4 >> col5 >> col6 >> col7 >> col8 >> col9 >> col10 >> col11) {
-//     if (col1 < hiteqm) continue;
-        ext.push_back(col2);
-        ke.push_back(col3);
-        pe.push_back(col4);
-        fake.push_back(col6);
-        real.push_back(col5);
-    }
-//   cout << "Sizes of ext and ke arrays" << setw(10) << ext.size() << setw(10) << ke.size() << endl;
-
-    double ext_mean = 0;
-    for (unsigned int i = 0; i < ext.size(); i++)
-        ext_mean += ext[i];
-    ext_mean = ext_mean / ext.size();
-    double ke_mean = 0;
-    for (unsigned int i = 0; i < ke.size(); i++)
-        ke_mean += ke[i];
-    ke_mean = ke_mean / ke.size();
-
-//   cout << "Mean ext and ke" << setw(10) << ext_mean << setw(10) << ke_mean << endl;
-
-    double ext_sd = 0;
-    for (unsigned int i = 0; i < ext.size(); i++)
-        ext_sd += (ext[i] - ext_mean) * (ext[i] - ext_mean);
-    ext_sd = ext_sd / ext.size();
-    ext_sd = sqrt(ext_sd);
-
-    double ke_sd = 0;
-    for (unsigned int i = 0; i < ke.size(); i++)
-        ke_sd += (ke[i] - ke_mean) * (ke[i] - ke_mean);
-    ke_sd = ke_sd / ke.size();
-    ke_sd = sqrt(ke_sd);
-
-
-    double R = ext_sd / ke_sd;
-//   cout << "R" << setw(15) <<  R << endl;
+    double ext_sd = trust_factors.extended.sd();
+    double ke_sd = trust_factors.ke.sd();
+    double R = trust_factors.R();
 
     if (world.rank() == 0) {
         ofstream out("outfiles/R.dat");
-        out << "Sample size " << ext.size() << endl;
+        out << "Sample size " << trust_factors.extended.n << endl;
         out << "Sd: ext, kinetic energy and R" << endl;
         out << ext_sd << setw(15) << ke_sd << setw(15) << R << endl;
     }
@@ -244,59 +250,17 @@ double compute_MD_trust_factor_R(int hiteqm) {
 }
 
 
-// compute MD trust factor R_v
+// compute MD trust factor R_v (from the running statistics of the extra computation steps)
 double compute_MD_trust_factor_R_v(int hiteqm) {
 
 
-    char filename[200];
-    sprintf(filename, "outfiles/energy.dat");
-    ifstream in(filename, ios::in);
-    if (!in) {
-        if (world.rank() == 0)
-            cout << "File could not be opened" << endl;
-        return 0;
-    }
-
-    int col1;
-    double col2, col3, col4, col5, col6, col7, col8, col9, col10, col11;
-    vector<double> ext, fake;
-    while (in >> col1 >> col2 >> col3 >> col4 >> col5 >> col6 >> col7 >> col8 >> col9 >> col10 >> col11) {
-
-        ext.push_back(col2);
-        fake.push_back(col6);
-
-    }
-    double ext_mean = 0;
-    for (unsigned int i = 0; i < ext.size(); i++)
-        ext_mean += ext[i];
-    ext_mean = ext_mean / ext.size();
-    double ke_mean_fake = 0;
-    for (unsigned int i = 0; i < fake.size(); i++)
-        ke_mean_fake += fake[i];
-    ke_mean_fake = ke_mean_fake / fake.size();
-
-//   cout << "Mean ext and ke" << setw(10) << ext_mean << setw(10) << ke_mean << endl;
-
-    double ext_sd = 0;
-    for (unsigned int i = 0; i < ext.size(); i++)
-        ext_sd += (ext[i] - ext_mean) * (ext[i] - ext_mean);
-    ext_sd = ext_sd / ext.size();
-    ext_sd = sqrt(ext_sd);
-
-    double ke_sd_fake = 0;
-    for (unsigned int i = 0; i < fake.size(); i++)
-        ke_sd_fake += (fake[i] - ke_mean_fake) * (fake[i] - ke_mean_fake);
-    ke_sd_fake = ke_sd_fake / fake.size();
-    ke_sd_fake = sqrt(ke_sd_fake);
-
-//   cout << "Standard deviations in ext and ke" << setw(10) << ext_sd << setw(10) << ke_sd << endl;
-
-    double RV = ext_sd / ke_sd_fake;
-//   cout << "RV" << setw(15) <<  RV << endl;
+    double ext_sd = trust_factors.extended.sd();
+    double ke_sd_fake = trust_factors.fake_ke.sd();
+    double RV = trust_factors.R_v();
 
     if (world.rank() == 0) {
         ofstream out("outfiles/RV.dat");
-        out << "Sample size " << ext.size() << endl;
+        out << "Sample size " << trust_factors.extended.n << endl;
         out << "Sd: ext, kinetic energy_fake and RV" << endl;
         out << ext_sd << setw(15) << ke_sd_fake << setw(15) << RV << endl;
     }
@@ -304,6 +268,37 @@ double compute_MD_trust_factor_R_v(int hiteqm) {
 }
 
 
+// binary series of the cpmd run (first process); column names as in the text files
+void set_up_series(unsigned int chunk_rows, bool text, const vector<string> &density_columns) {
+
+    series.text = text;
+    if (world.rank() != 0)
+        return;
+    const char *energy[] = {"extended", "ke", "pe", "real", "fake_ke", "fake", "real_bath_ke", "real_bath_pe",
+                            "fake_bath_ke", "fake_bath_pe"};
+    const char *temperature[] = {"real", "real_bath", "fake", "fake_bath"};
+    const char *induced_charge[] = {"total_induced_charge"};
+    const char *track_density[] = {"cpmd", "exact"};
+    const char *track_deviation[] = {"deviation"};
+    const char *trust_factor[] = {"R", "R_v"};
+    series.energy.set_up("outfiles/energy.series", vector<string>(energy, energy + 10), chunk_rows);
+    series.temperature.set_up("outfiles/temperature.series", vector<string>(temperature, temperature + 4), chunk_rows);
+    series.induced_charge.set_up("outfiles/total_induced_charge.series",
+                                 vector<string>(induced_charge, induced_charge + 1), chunk_rows);
+    series.track_density.set_up("outfiles/track_density.series", vector<string>(track_density, track_density + 2),
+                                chunk_rows);
+    series.track_functional.set_up("outfiles/track_functional.series",
+                                   vector<string>(track_density, track_density + 2), chunk_rows);
+    series.track_deviation.set_up("outfiles/track_deviation.series",
+                                  vector<string>(track_deviation, track_deviation + 1), chunk_rows);
+    series.trust_factor.set_up("outfiles/trust_factor.series", vector<string>(trust_factor, trust_factor + 2),
+                               chunk_rows);
+    if (!density_columns.empty())
+        series.density.set_up("outfiles/density_samples.series", density_columns, chunk_rows);
+    return;
+}
+
+
 void progressBar(double fraction_completed) {
 
 
@@ -316,46 +311,44 @@ void progressBar(double fraction_completed) {
     }
 }
 
-/*
-// auto correlation function
-void auto_correlation_function()
-{
-  char filename[200];
-  sprintf(filename, "outfiles/for_auto_corr.dat");
-  ifstream in(filename, ios::in);
-  if (!in) 
-  {
-    cout << "File could not be opened" << endl; 
+// error analysis of the density samples (first process, bins over its threads): the statistical inefficiency of
+// each bin widens its error bar in the final density profile
+void analyse_density_samples(NanoParticle *nanoParticle, CONTROL &cpmdremote) {
+
+
+    vector<string> names;
+    vector<SAMPLE_STATISTICS> statistics;
+    if (!analyse_series("outfiles/density_samples.series", names, statistics)) {
+        cout << "Density samples could not be read; the error bars take the samples as independent" << endl;
+        return;
+    }
+
+    nanoParticle->inefficiency.resize(statistics.size());
+    ofstream out("outfiles/density_analysis.dat");
+    out << "# bin samples mean naive_error inefficiency error blocking_error" << endl;
+    vector<double> inefficiencies;
+    unsigned int slowest = 0;
+    for (unsigned int c = 0; c < statistics.size(); c++) {
+        nanoParticle->inefficiency[c] = statistics[c].inefficiency;
+        out << names[c] << setw(15) << statistics[c].samples << setw(15) << statistics[c].mean << setw(15)
+            << statistics[c].naive_error << setw(15) << statistics[c].inefficiency << setw(15) << statistics[c].error
+            << setw(15) << statistics[c].blocking_error << endl;
+        if (statistics[c].naive_error > 0) {
+            inefficiencies.push_back(statistics[c].inefficiency);
+            if (statistics[c].inefficiency > statistics[slowest].inefficiency)
+                slowest = c;
+        }
+    }
+    out.close();
+
+    if (cpmdremote.verbose && !inefficiencies.empty()) {
+        sort(inefficiencies.begin(), inefficiencies.end());
+        cout << "Statistical inefficiency of the density bins (median, largest)" << setw(15)
+             << inefficiencies[inefficiencies.size() / 2] << setw(15) << statistics[slowest].inefficiency << " ("
+             << names[slowest] << ")" << endl;
+        cout << "Independent density samples in that bin" << setw(15)
+             << statistics[slowest].samples / statistics[slowest].inefficiency << " of " << statistics[slowest].samples
+             << endl;
+    }
     return;
-  }
-
-  double col1, col2;
-  vector<double> n, autocorr;
-  while (in >> col1 >> col2)
-    n.push_back(col2);
-//   cout << "Number of samples after eqm" << setw(10) << n.size() << endl;
-
-  double avg = 0;
-  for (unsigned int j = 0; j< n.size(); j++)
-    avg = avg + n[j];
-  avg = avg / n.size();
-
-  int ntau = 5000;			// time to which the auto correlation function is computed 
-  
-  for (int i = 0; i < ntau; i++)
-  {
-    double A = 0;
-    for (unsigned int j = 0; j< n.size(); j++)
-      A = A + n[j+i]*n[j];
-    A = A / n.size();
-    autocorr.push_back(A - avg*avg);
-  }
-
-  ofstream out ("outfiles/auto_correlation.dat");
-  for (int i = 0; i < ntau; i++)
-    out << i << setw(15) << autocorr[i]/autocorr[0] << endl;
-  
-  cout << "Auto correlation function generated" << endl;
-  return;
 }
-*/
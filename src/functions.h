@@ -14,6 +14,14 @@
 #include "forces.h"
 #include "energies.h"
 #include "mpi_utility.h"
+#include "ion_pairs.h"
+#include "short_range.h"
+#include "output.h"
+#include "trajectory.h"
+#include "series.h"
+#include "trust_factor.h"
+#include "analysis.h"
+#include <sstream>
 
 
 #define PBSTR "||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||"
@@ -36,28 +44,32 @@ void fmd(vector<VERTEX> &, vector<PARTICLE> &, NanoParticle *, CONTROL &, CONTRO
 // car parrinello molecular dynamics (cpmd)
 void cpmd(vector<PARTICLE> &, vector<VERTEX> &, NanoParticle *, vector<THERMOSTAT> &, vector<THERMOSTAT> &, CONTROL &, CONTROL &);
 
-// compute and write useful data in cpmd
+// compute and write useful data in cpmd (the potential energy comes from the force evaluation of the step)
 void compute_n_write_useful_data(int, vector<PARTICLE> &, vector<VERTEX> &, vector<THERMOSTAT> &, vector<THERMOSTAT> &,
-                                 NanoParticle *);
+                                 NanoParticle *, double);
 
 // verify with F M D
-double verify_with_FMD(int, vector<VERTEX>, vector<PARTICLE> &, NanoParticle *, CONTROL &, CONTROL &);
+double verify_with_FMD(int, vector<VERTEX> &, vector<PARTICLE> &, NanoParticle *, CONTROL &, CONTROL &);
 
 // make movie
 void make_movie(int num, vector<PARTICLE> &, NanoParticle *);
 
 
-// post analysis : compute R
+// post analysis : compute R (the running value, also written at every extra computation step)
 double compute_MD_trust_factor_R(int);
 
-// post analysis : compute T factor
+// post analysis : compute T factor (R_v, running as R)
 double compute_MD_trust_factor_R_v(int);
 
+// binary series of the cpmd run, in chunks of chunk_rows; text also writes the text files; the density samples
+// are kept if there are density columns
+void set_up_series(unsigned int chunk_rows, bool text, const vector<string> &density_columns);
+
 // display progress bar (code from the internet)
 void progressBar(double);
 
-// post analysis : auto correlation function
-//void auto_correlation_function();
+// post analysis : autocorrelation and blocking of the density samples
+void analyse_density_samples(NanoParticle *, CONTROL &);
 
 
 // functions useful in computing forces and energies
@@ -95,17 +107,21 @@ inline VECTOR3D GradndotGrad(VECTOR3D &vec1, VECTOR3D &vec2, VECTOR3D &normal) {
 // functions useful in implementing constraint
 // -------------------------------------------
 
+// total induced charge required by the constraint
+inline double constraint_charge(vector<PARTICLE> &ion, NanoParticle *nanoParticle) {
+    return nanoParticle->total_charge_inside(ion) * (1 / nanoParticle->eout - 1 / nanoParticle->ein);
+}
+
 // constraint equation
-inline long double constraint(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle *nanoParticle) {
-    return (nanoParticle->total_induced_charge(s) -
-            nanoParticle->total_charge_inside(ion) * (1 / nanoParticle->eout - 1 / nanoParticle->ein));
+inline REAL constraint(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle *nanoParticle) {
+    return (nanoParticle->total_induced_charge(s) - constraint_charge(ion, nanoParticle));
 }
 
 // SHAKE to ensure constraint is true
 inline void SHAKE(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle *nanoParticle,
                   CONTROL &simremote)    // remote of the considered simulation
 {
-    long double sigma = constraint(s, ion, nanoParticle);
+    REAL sigma = constraint(s, ion, nanoParticle);
     for (unsigned int k = 0; k < s.size(); k++)
         s[k].vw = s[k].vw - (1.0 / simremote.timestep) * sigma / (s[k].a * int(s.size()));
     for (unsigned int k = 0; k < s.size(); k++)
@@ -114,8 +130,8 @@ inline void SHAKE(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle *nanoPa
 }
 
 // dot constraint equation
-inline long double dotconstraint(vector<VERTEX> &s) {
-    long double sigmadot = 0;
+inline REAL dotconstraint(vector<VERTEX> &s) {
+    REAL sigmadot = 0;
     for (unsigned int k = 0; k < s.size(); k++)
         sigmadot += s[k].vw * s[k].a;
     return sigmadot;
@@ -123,7 +139,7 @@ inline long double dotconstraint(vector<VERTEX> &s) {
 
 // RATTLE to ensure time derivative of the constraint is true
 inline void RATTLE(vector<VERTEX> &s) {
-    long double sigmadot = dotconstraint(s);
+    REAL sigmadot = dotconstraint(s);
     for (unsigned int k = 0; k < s.size(); k++)
         s[k].vw = s[k].vw - sigmadot / (s[k].a * int(s.size()));
     return;
@@ -133,7 +149,7 @@ inline void RATTLE(vector<VERTEX> &s) {
 // -------------------------------------------
 
 // update bath xi value
-inline void update_chain_xi(unsigned int j, vector<THERMOSTAT> &bath, double dt, long double ke) {
+inline void update_chain_xi(unsigned int j, vector<THERMOSTAT> &bath, double dt, REAL ke) {
     if (bath[j].Q == 0)
         return;
     if (j != 0)
@@ -163,11 +179,7 @@ write_basic_files(int write, int cpmdstep, vector<PARTICLE> &ion, vector<VERTEX>
         return;
 
     if (world.rank() == 0) {
-        ofstream list_position("outfiles/ion_position.dat", ios::app);
-        ofstream list_velocity("outfiles/ion_velocity.dat", ios::app);
-        ofstream list_force("outfiles/ion_force.dat", ios::app);
-        ofstream list_fake("outfiles/fake_values.dat", ios::app);
-        ofstream list_bath("outfiles/bath_values.dat", ios::app);
+        ostringstream list_position, list_velocity, list_force, list_fake, list_bath;
 
         list_position << cpmdstep << setw(15) << ion[0].posvec.GetMagnitude() << setw(15)
                       << ion[1].posvec.GetMagnitude()
@@ -181,6 +193,11 @@ write_basic_files(int write, int cpmdstep, vector<PARTICLE> &ion, vector<VERTEX>
         list_bath << cpmdstep << setw(15) << real_bath[0].xi << setw(15) << real_bath[0].eta << setw(15)
                   << fake_bath[0].xi
                   << setw(15) << fake_bath[0].eta << endl;
+        output.append("outfiles/ion_position.dat", list_position.str());
+        output.append("outfiles/ion_velocity.dat", list_velocity.str());
+        output.append("outfiles/ion_force.dat", list_force.str());
+        output.append("outfiles/fake_values.dat", list_fake.str());
+        output.append("outfiles/bath_values.dat", list_bath.str());
     }
     return;
 }
@@ -0,0 +1,27 @@
+// This file contains the density histograms
+
+#include "histogram.h"
+
+void Histogram::set_up(unsigned int bins_per_sign) {
+
+    bins = bins_per_sign;
+    thread_counts.assign(omp_get_max_threads(), vector<double>(2 * bins, 0.0));
+    local.assign(2 * bins, 0.0);
+    counts.assign(2 * bins, 0.0);
+    return;
+}
+
+void Histogram::reduce() {
+
+    for (unsigned int k = 0; k < local.size(); k++) {
+        double sum = 0;
+        for (unsigned int t = 0; t < thread_counts.size(); t++)
+            sum += thread_counts[t][k];
+        local[k] = sum;
+    }
+    if (world.size() > 1)
+        mpi::reduce(world, &local[0], local.size(), &counts[0], std::plus<double>(), 0);
+    else
+        counts = local;
+    return;
+}
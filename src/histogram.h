@@ -0,0 +1,58 @@
+// This is a header file for the density histograms
+// Every process bins its own ions (lowerBoundIons..upperBoundIons) with its OpenMP threads, each into private
+// counts; the thread counts are added up and one reduce gives the counts of all ions on the first process.
+// The counts are allocated once (set_up, from make_bins) and reused for every sample.
+
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+
+#include "particle.h"
+#include "mpi_utility.h"
+#include <functional>
+#include <omp.h>
+
+class Histogram {
+
+public:
+    vector<double> counts;      // positive ion bins, then negative ion bins; all ions, on the first process
+
+    // bins per sign
+    void set_up(unsigned int);
+
+    // count the ions of this process in bin(ion) (-1 if outside the bins), then reduce to the first process
+    template<typename BIN>
+    void fill(const vector<PARTICLE> &, BIN);
+
+private:
+    unsigned int bins;
+    vector<vector<double> > thread_counts;
+    vector<double> local;
+
+    void reduce();
+};
+
+template<typename BIN>
+void Histogram::fill(const vector<PARTICLE> &ion, BIN bin) {
+
+    int lower = lowerBoundIons;
+    int upper = min((int) upperBoundIons, (int) ion.size() - 1);
+    // every slot is cleared, since the runtime may start a smaller team than there are slots
+    for (unsigned int t = 0; t < thread_counts.size(); t++)
+        std::fill(thread_counts[t].begin(), thread_counts[t].end(), 0.0);
+
+#pragma omp parallel num_threads(thread_counts.size())
+    {
+        vector<double> &mine = thread_counts[omp_get_thread_num()];
+#pragma omp for schedule(static)
+        for (int i = lower; i <= upper; i++) {
+            int b = bin(ion[i]);
+            //Assuming 0 valency never exists
+            if (b >= 0)
+                mine[(ion[i].valency > 0 ? 0 : bins) + b] += 1;
+        }
+    }
+    reduce();
+    return;
+}
+
+#endif
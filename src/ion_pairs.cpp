@@ -0,0 +1,166 @@
+// This file contains the ion - ion pair kernels (Coulomb force and energy in one pass)
+
+#include "ion_pairs.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define ION_PAIRS_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*ION_PAIR_KERNEL)(const ION_ARRAYS &, unsigned int, ION_PAIR_SUMS &);
+
+// raw sums before the per-ion prefactors: c = sum q_j (1/eps_i + 1/eps_j) (r_i - r_j) / r^3, e = sum q_j / r
+struct RAW_SUMS {
+    double c[3], e;
+};
+
+// pairs i, j for j in [begin, end); the ion itself (r = 0) is skipped
+static void pair_sums_range(const ION_ARRAYS &a, unsigned int i, unsigned int begin, unsigned int end,
+                            RAW_SUMS &sums) {
+    double xi = a.x[i], yi = a.y[i], zi = a.z[i];
+    double iei = a.inv_epsilon[i];
+    for (unsigned int j = begin; j < end; j++) {
+        double dx = xi - a.x[j], dy = yi - a.y[j], dz = zi - a.z[j];
+        double r2 = dx * dx + dy * dy + dz * dz;
+        if (r2 == 0)
+            continue;
+        double inv_r = 1.0 / sqrt(r2);
+        double inv_r2 = inv_r * inv_r;
+        double c = a.q[j] * (iei + a.inv_epsilon[j]) * inv_r2 * inv_r;
+        sums.c[0] += c * dx;
+        sums.c[1] += c * dy;
+        sums.c[2] += c * dz;
+        sums.e += a.q[j] * inv_r;
+    }
+}
+
+static void finish(const ION_ARRAYS &a, unsigned int i, const RAW_SUMS &sums, ION_PAIR_SUMS &out) {
+    for (int c = 0; c < 3; c++)
+        out.coulomb[c] = 0.5 * a.q[i] * sums.c[c];
+    out.coulomb_energy = 0.5 * a.q[i] * a.inv_epsilon[i] * sums.e;
+}
+
+static void pair_sums_scalar(const ION_ARRAYS &a, unsigned int i, ION_PAIR_SUMS &out) {
+    RAW_SUMS sums = {{0, 0, 0}, 0};
+    pair_sums_range(a, i, 0, a.n, sums);
+    finish(a, i, sums, out);
+}
+
+#ifdef ION_PAIRS_X86
+
+__attribute__((target("avx2,fma")))
+static inline double hsum_avx2(__m256d v) {
+    __m128d lo = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+// four j at a time; the ion itself is masked out
+__attribute__((target("avx2,fma")))
+static void pair_sums_avx2(const ION_ARRAYS &a, unsigned int i, ION_PAIR_SUMS &out) {
+    const __m256d xi = _mm256_set1_pd(a.x[i]), yi = _mm256_set1_pd(a.y[i]), zi = _mm256_set1_pd(a.z[i]);
+    const __m256d iei = _mm256_set1_pd(a.inv_epsilon[i]);
+    const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+    __m256d cx = zero, cy = zero, cz = zero, e = zero;
+
+    unsigned int n4 = a.n & ~3u;
+    for (unsigned int j = 0; j < n4; j += 4) {
+        __m256d dx = _mm256_sub_pd(xi, _mm256_loadu_pd(&a.x[j]));
+        __m256d dy = _mm256_sub_pd(yi, _mm256_loadu_pd(&a.y[j]));
+        __m256d dz = _mm256_sub_pd(zi, _mm256_loadu_pd(&a.z[j]));
+        __m256d r2 = _mm256_fmadd_pd(dz, dz, _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dx, dx)));
+        __m256d other = _mm256_cmp_pd(r2, zero, _CMP_GT_OQ);
+        __m256d inv_r = _mm256_and_pd(_mm256_div_pd(one, _mm256_sqrt_pd(r2)), other);
+        __m256d inv_r2 = _mm256_mul_pd(inv_r, inv_r);
+
+        __m256d qj = _mm256_loadu_pd(&a.q[j]);
+        __m256d c = _mm256_mul_pd(_mm256_mul_pd(qj, _mm256_add_pd(iei, _mm256_loadu_pd(&a.inv_epsilon[j]))),
+                                  _mm256_mul_pd(inv_r2, inv_r));
+        cx = _mm256_fmadd_pd(c, dx, cx);
+        cy = _mm256_fmadd_pd(c, dy, cy);
+        cz = _mm256_fmadd_pd(c, dz, cz);
+        e = _mm256_fmadd_pd(qj, inv_r, e);
+    }
+
+    RAW_SUMS sums = {{hsum_avx2(cx), hsum_avx2(cy), hsum_avx2(cz)}, hsum_avx2(e)};
+    pair_sums_range(a, i, n4, a.n, sums);
+    finish(a, i, sums, out);
+}
+
+// sum of the eight lanes, in the order of _mm512_reduce_add_pd (whose GCC 12 expansion draws -Wuninitialized)
+__attribute__((target("avx512f")))
+static inline double horizontal_sum(__m512d v) {
+    double lane[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    _mm512_storeu_pd(lane, v);
+    double s[4];
+    for (int k = 0; k < 4; k++)
+        s[k] = lane[k + 4] + lane[k];
+    return (s[2] + s[0]) + (s[3] + s[1]);
+}
+
+// eight j at a time, with mask registers
+__attribute__((target("avx512f")))
+static void pair_sums_avx512(const ION_ARRAYS &a, unsigned int i, ION_PAIR_SUMS &out) {
+    const __m512d xi = _mm512_set1_pd(a.x[i]), yi = _mm512_set1_pd(a.y[i]), zi = _mm512_set1_pd(a.z[i]);
+    const __m512d iei = _mm512_set1_pd(a.inv_epsilon[i]);
+    const __m512d zero = _mm512_setzero_pd(), one = _mm512_set1_pd(1.0);
+    __m512d cx = zero, cy = zero, cz = zero, e = zero;
+
+    unsigned int n8 = a.n & ~7u;
+    for (unsigned int j = 0; j < n8; j += 8) {
+        __m512d dx = _mm512_sub_pd(xi, _mm512_loadu_pd(&a.x[j]));
+        __m512d dy = _mm512_sub_pd(yi, _mm512_loadu_pd(&a.y[j]));
+        __m512d dz = _mm512_sub_pd(zi, _mm512_loadu_pd(&a.z[j]));
+        __m512d r2 = _mm512_fmadd_pd(dz, dz, _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dx, dx)));
+        __mmask8 other = _mm512_cmp_pd_mask(r2, zero, _CMP_GT_OQ);
+        __m512d inv_r = _mm512_mask_div_pd(zero, other, one, _mm512_mask_sqrt_pd(one, other, r2));
+        __m512d inv_r2 = _mm512_mul_pd(inv_r, inv_r);
+
+        __m512d qj = _mm512_loadu_pd(&a.q[j]);
+        __m512d c = _mm512_mul_pd(_mm512_mul_pd(qj, _mm512_add_pd(iei, _mm512_loadu_pd(&a.inv_epsilon[j]))),
+                                  _mm512_mul_pd(inv_r2, inv_r));
+        cx = _mm512_fmadd_pd(c, dx, cx);
+        cy = _mm512_fmadd_pd(c, dy, cy);
+        cz = _mm512_fmadd_pd(c, dz, cz);
+        e = _mm512_fmadd_pd(qj, inv_r, e);
+    }
+
+    RAW_SUMS sums = {{horizontal_sum(cx), horizontal_sum(cy), horizontal_sum(cz)}, horizontal_sum(e)};
+    pair_sums_range(a, i, n8, a.n, sums);
+    finish(a, i, sums, out);
+}
+
+#endif
+
+static ION_PAIR_KERNEL kernel = pair_sums_scalar;
+static const char *kernel_name = "scalar";
+
+bool select_ion_pair_kernel(const string &name) {
+#ifdef ION_PAIRS_X86
+    bool avx512 = __builtin_cpu_supports("avx512f");
+    bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if ((name == "auto" && avx512) || (name == "avx512" && avx512)) {
+        kernel = pair_sums_avx512;
+        kernel_name = "avx512";
+        return true;
+    }
+    if ((name == "auto" && avx2) || (name == "avx2" && avx2)) {
+        kernel = pair_sums_avx2;
+        kernel_name = "avx2";
+        return true;
+    }
+#endif
+    if (name == "auto" || name == "scalar") {
+        kernel = pair_sums_scalar;
+        kernel_name = "scalar";
+        return true;
+    }
+    return false;
+}
+
+const char *ion_pair_kernel_name() {
+    return kernel_name;
+}
+
+void ion_pair_sums(const ION_ARRAYS &a, unsigned int i, ION_PAIR_SUMS &out) {
+    kernel(a, i, out);
+}
@@ -0,0 +1,61 @@
+// This is a header file for the ion - ion pair kernels
+// The ion - ion Coulomb sums run over a structure-of-arrays mirror of the ions in double precision,
+// with explicitly vectorized (AVX-512, AVX2) kernels chosen at runtime and a scalar fallback
+
+#ifndef _ION_PAIRS_H
+#define _ION_PAIRS_H
+
+#include <string>
+#include "particle.h"
+
+// positions, charges, 1/epsilon and diameters of the ions; the positions are refreshed by the integrator
+// (cpmd) after every position update, the rest is set once
+struct ION_ARRAYS {
+    unsigned int n;
+    vector<double> x, y, z;
+    vector<double> q, inv_epsilon, diameter;
+
+    void load(const vector<PARTICLE> &ion) {
+        n = ion.size();
+        x.resize(n);
+        y.resize(n);
+        z.resize(n);
+        q.resize(n);
+        inv_epsilon.resize(n);
+        diameter.resize(n);
+        for (unsigned int i = 0; i < n; i++) {
+            q[i] = ion[i].q;
+            inv_epsilon[i] = 1.0 / ion[i].epsilon;
+            diameter[i] = ion[i].diameter;
+        }
+        sync_positions(ion);
+    }
+
+    void sync_positions(const vector<PARTICLE> &ion) {
+        for (unsigned int i = 0; i < n; i++) {
+            x[i] = ion[i].posvec.x;
+            y[i] = ion[i].posvec.y;
+            z[i] = ion[i].posvec.z;
+        }
+    }
+};
+
+extern ION_ARRAYS ion_arrays;
+
+// sums over all ions j != i of one pass (the short-range LJ terms are in short_range.h):
+//      coulomb        = 0.5 q_i sum_j q_j (1/eps_i + 1/eps_j) (r_i - r_j) / r^3    (force, before scalefactor)
+//      coulomb_energy = 0.5 q_i / eps_i sum_j q_j / r
+struct ION_PAIR_SUMS {
+    double coulomb[3];
+    double coulomb_energy;
+};
+
+// kernel used by ion_pair_sums: auto picks the widest one the processor supports;
+// returns false for an unknown or unsupported name
+bool select_ion_pair_kernel(const string &name);
+
+const char *ion_pair_kernel_name();
+
+void ion_pair_sums(const ION_ARRAYS &, unsigned int i, ION_PAIR_SUMS &);
+
+#endif
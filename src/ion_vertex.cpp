@@ -0,0 +1,138 @@
+// This file contains the ion - vertex interaction kernels (Green's function and its gradients on the fly)
+
+#include "ion_vertex.h"
+
+// a few rows of one side are run against a tile of the other side that stays in cache
+static const unsigned int ROW_TILE = 8;
+static const unsigned int COLUMN_TILE = 128;
+
+void ion_vertex_vertex_sums(const vector<VERTEX> &s, const vector<PARTICLE> &ion, unsigned int lower,
+                            unsigned int upper, unsigned int ion_lower, unsigned int ion_upper, double em,
+                            vector<REAL> &g3, vector<REAL> &g4, vector<REAL> &gq) {
+
+    unsigned int n = ion_upper + 1 - ion_lower;
+    vector<REAL> x(n), y(n), z(n), qe(n), qw(n);
+    for (unsigned int i = 0; i < n; i++) {
+        const PARTICLE &p = ion[ion_lower + i];
+        x[i] = p.posvec.x;
+        y[i] = p.posvec.y;
+        z[i] = p.posvec.z;
+        qe[i] = p.q / p.epsilon;
+        qw[i] = (0.5 - 0.5 * em / p.epsilon) * p.q;
+    }
+
+    int tiles = (upper - lower + ROW_TILE) / ROW_TILE;
+#pragma omp parallel for schedule(dynamic) default(shared)
+    for (int t = 0; t < tiles; t++) {
+        unsigned int k0 = lower + t * ROW_TILE, k1 = min(upper + 1, k0 + ROW_TILE);
+        for (unsigned int k = k0; k < k1; k++)
+            g3[k - lower] = g4[k - lower] = gq[k - lower] = 0;
+
+        for (unsigned int i0 = 0; i0 < n; i0 += COLUMN_TILE) {
+            unsigned int i1 = min(n, i0 + COLUMN_TILE);
+            for (unsigned int k = k0; k < k1; k++) {
+                REAL sx = s[k].posvec.x, sy = s[k].posvec.y, sz = s[k].posvec.z;
+                REAL nx = s[k].normalvec.x, ny = s[k].normalvec.y, nz = s[k].normalvec.z;
+                REAL a3 = g3[k - lower], a4 = g4[k - lower], aq = gq[k - lower];
+                for (unsigned int i = i0; i < i1; i++) {
+                    REAL ex = sx - x[i], ey = sy - y[i], ez = sz - z[i];
+                    REAL G = 1.0 / sqrt(ex * ex + ey * ey + ez * ez);
+                    a3 += G * qe[i];
+                    a4 -= (nx * ex + ny * ey + nz * ez) * (G * G * G) * qe[i];
+                    aq += qw[i] * G;
+                }
+                g3[k - lower] = a3;
+                g4[k - lower] = a4;
+                gq[k - lower] = aq;
+            }
+        }
+    }
+    return;
+}
+
+// vertex layout of the ion pass
+struct VERTEX_COLUMNS {
+    vector<REAL> x, y, z, nx, ny, nz;
+
+    explicit VERTEX_COLUMNS(const vector<VERTEX> &s) : x(s.size()), y(s.size()), z(s.size()), nx(s.size()),
+                                                        ny(s.size()), nz(s.size()) {
+        for (unsigned int k = 0; k < s.size(); k++) {
+            x[k] = s[k].posvec.x;
+            y[k] = s[k].posvec.y;
+            z[k] = s[k].posvec.z;
+            nx[k] = s[k].normalvec.x;
+            ny[k] = s[k].normalvec.y;
+            nz[k] = s[k].normalvec.z;
+        }
+    }
+};
+
+// vertices k0..k1 added to the sums of the ion at (xi, yi, zi)
+template<bool ENERGY>
+static void ion_vertex_tile(const VERTEX_COLUMNS &v, const ION_VERTEX_WEIGHTS &w, unsigned int k0, unsigned int k1,
+                            REAL xi, REAL yi, REAL zi, ION_VERTEX_SUMS &sums) {
+    REAL dwx = sums.dw[0], dwy = sums.dw[1], dwz = sums.dw[2];
+    REAL dhx = sums.dh2[0], dhy = sums.dh2[1], dhz = sums.dh2[2];
+    REAL h4x = sums.h4[0], h4y = sums.h4[1], h4z = sums.h4[2];
+    REAL Gw = sums.Gw, Gh2 = sums.Gh2, ne4 = sums.ne4;
+
+    for (unsigned int k = k0; k < k1; k++) {
+        REAL dx = xi - v.x[k], dy = yi - v.y[k], dz = zi - v.z[k];
+        REAL G = 1.0 / sqrt(dx * dx + dy * dy + dz * dz);
+        REAL G3 = G * G * G;
+        REAL nd = v.nx[k] * dx + v.ny[k] * dy + v.nz[k] * dz;
+
+        REAL cw = w.wa[k] * G3, ch = w.h2a[k] * G3;
+        dwx += cw * dx;
+        dwy += cw * dy;
+        dwz += cw * dz;
+        dhx += ch * dx;
+        dhy += ch * dy;
+        dhz += ch * dz;
+
+        REAL c4 = w.h4a[k] * G3, c5 = 3 * nd * G * G * c4;
+        h4x += c4 * v.nx[k] - c5 * dx;
+        h4y += c4 * v.ny[k] - c5 * dy;
+        h4z += c4 * v.nz[k] - c5 * dz;
+
+        if (ENERGY) {
+            Gw += G * w.wa[k];
+            Gh2 += G * w.h2a[k];
+            ne4 += nd * G3 * w.e4a[k];
+        }
+    }
+
+    sums.dw[0] = dwx, sums.dw[1] = dwy, sums.dw[2] = dwz;
+    sums.dh2[0] = dhx, sums.dh2[1] = dhy, sums.dh2[2] = dhz;
+    sums.h4[0] = h4x, sums.h4[1] = h4y, sums.h4[2] = h4z;
+    sums.Gw = Gw, sums.Gh2 = Gh2, sums.ne4 = ne4;
+}
+
+void ion_vertex_ion_sums(const vector<VERTEX> &s, const vector<PARTICLE> &ion, unsigned int lower, unsigned int upper,
+                         unsigned int vertex_lower, unsigned int vertex_upper, const ION_VERTEX_WEIGHTS &w,
+                         bool with_energy, vector<ION_VERTEX_SUMS> &out) {
+
+    VERTEX_COLUMNS v(s);
+    unsigned int n = vertex_upper + 1;
+    out.resize(upper - lower + 1);
+
+    int tiles = (upper - lower + ROW_TILE) / ROW_TILE;
+#pragma omp parallel for schedule(dynamic) default(shared)
+    for (int t = 0; t < tiles; t++) {
+        unsigned int i0 = lower + t * ROW_TILE, i1 = min(upper + 1, i0 + ROW_TILE);
+        for (unsigned int i = i0; i < i1; i++)
+            out[i - lower] = ION_VERTEX_SUMS();
+
+        for (unsigned int k0 = vertex_lower; k0 < n; k0 += COLUMN_TILE) {
+            unsigned int k1 = min(n, k0 + COLUMN_TILE);
+            for (unsigned int i = i0; i < i1; i++) {
+                const VECTOR3D &r = ion[i].posvec;
+                if (with_energy)
+                    ion_vertex_tile<true>(v, w, k0, k1, r.x, r.y, r.z, out[i - lower]);
+                else
+                    ion_vertex_tile<false>(v, w, k0, k1, r.x, r.y, r.z, out[i - lower]);
+            }
+        }
+    }
+    return;
+}
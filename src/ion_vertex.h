@@ -0,0 +1,37 @@
+// This is a header file for the ion - vertex interaction kernels
+// G = 1/|s_k - r_i|, its gradient and the gradient of n_k . grad G are computed on the fly, in tiles of
+// vertices and ions, and reduced straight into the per-vertex and per-ion sums of the force routines;
+// no N_s x N_ion table is kept
+
+#ifndef _ION_VERTEX_H
+#define _ION_VERTEX_H
+
+#include "vertex.h"
+#include "particle.h"
+
+// w independent sums over the ions ion_lower..ion_upper for the vertices lower..upper, stored at k - lower:
+//      g3[k] = sum_i G q_i/eps_i
+//      g4[k] = sum_i n_k . Grad(s_k, r_i) q_i/eps_i
+//      gq[k] = sum_i (0.5 - 0.5 em/eps_i) q_i G
+void ion_vertex_vertex_sums(const vector<VERTEX> &, const vector<PARTICLE> &, unsigned int lower, unsigned int upper,
+                            unsigned int ion_lower, unsigned int ion_upper, double em, vector<REAL> &g3,
+                            vector<REAL> &g4, vector<REAL> &gq);
+
+// weights of the vertices in the ion sums, all of length N_s (e4a is only read when energies are asked for)
+struct ION_VERTEX_WEIGHTS {
+    vector<REAL> wa, h2a, h4a, e4a;
+};
+
+// raw sums over the vertices for one ion, with d = r_i - s_k (the prefactors of each ion are left to the caller)
+struct ION_VERTEX_SUMS {
+    REAL dw[3], dh2[3];             // sum_k d/r^3 times wa and h2a
+    REAL h4[3];                     // sum_k (n_k/r^3 - 3 d (n_k . d)/r^5) h4a
+    REAL Gw, Gh2, ne4;              // sum_k G wa, G h2a and (n_k . d)/r^3 e4a (energies only)
+};
+
+// sums over the vertices vertex_lower..vertex_upper of the ions lower..upper, stored at i - lower
+void ion_vertex_ion_sums(const vector<VERTEX> &, const vector<PARTICLE> &, unsigned int lower, unsigned int upper,
+                         unsigned int vertex_lower, unsigned int vertex_upper, const ION_VERTEX_WEIGHTS &,
+                         bool with_energy, vector<ION_VERTEX_SUMS> &);
+
+#endif
@@ -39,13 +39,21 @@
 unsigned int lowerBoundIons;
 unsigned int upperBoundIons;
 unsigned int sizFVecIons;
-unsigned int extraElementsIons;
 unsigned int lowerBoundMesh;
 unsigned int upperBoundMesh;
 unsigned int sizFVecMesh;
-unsigned int extraElementsMesh;
-mpi::environment env;
+mpi::environment env(mpi::threading::funneled);      // the master thread of a parallel region may call MPI
 mpi::communicator world;
+Exchange mesh_exchange;
+Exchange ion_exchange;
+
+ION_ARRAYS ion_arrays;              // structure-of-arrays mirror of the ions for the pair kernels
+NeighborList neighbor_list;         // ion - ion neighbors of the short-range LJ interactions
+Decomposition decomposition;        // split of the ion - vertex interaction work over the processes
+OutputManager output;               // files written in the cpmd step loop (by a writer thread)
+TrajectoryWriter trajectory(output);    // binary movie of the ions
+SERIES_LOGS series(output);         // binary energy, temperature, induced charge and track series
+TrustFactors trust_factors;         // running R and R_v
 
 vector<int> condensedIonsPerStep; // Number of condensed ions per step (after equilibrium) at specified frequency
 
@@ -90,6 +98,19 @@ int main(int argc, char *argv[]) {
     vector<PARTICLE> ion;        // all ions in the system
     vector<VERTEX> s;        // all vertices
 
+    string operator_cache_dir;    // directory of the precalculated operator cache
+    string polarization_solver;   // how the induced charges are found: cpmd, cholesky or pcg
+    double solver_tolerance;      // relative residual of the pcg solver
+    string pair_kernel;           // ion - ion pair kernel: auto, avx512, avx2 or scalar
+    string surface_field;         // field of the fixed interface charges: direct or table
+    double surface_field_tolerance;   // largest relative interpolation error of the table
+    string decomposition_name;    // ion - vertex work over the processes: 1d or 2d
+    unsigned int output_queue;    // records the cpmd output ring holds
+    string movie_format;          // movie of the ions: float32, quantized or lammpstrj
+    bool movie_compression;       // deflate the frames of the binary movie
+    unsigned int series_chunk;    // rows per chunk of the binary series
+    bool series_text;             // also write the series as text files
+
     // Analysis
     string np_shape; // np shape
     NanoParticle *nanoParticle;
@@ -145,7 +166,43 @@ int main(int argc, char *argv[]) {
             ("cpmd_extra_compute,X", value<int>(&cpmdremote.extra_compute)->default_value(1000),
              "compute additional (cpmd)")
             ("cpmd_writedensity,W", value<int>(&cpmdremote.writedensity)->default_value(10000), "write density files")
+            ("cpmd_respa_steps", value<int>(&cpmdremote.respa_steps)->default_value(1),
+             "r-RESPA: inner steps of the LJ forces per cpmd time step, at which the electrostatic forces are evaluated (1: all forces every step)")
+            ("checkpoint_every", value<int>(&cpmdremote.checkpoint)->default_value(0),
+             "write a checkpoint every this many cpmd steps (0: only when stopped by SIGTERM or SIGUSR1)")
+            ("checkpoint_file", value<string>(&cpmdremote.checkpoint_file)->default_value("outfiles/checkpoint.bin"),
+             "checkpoint of the cpmd run")
+            ("restart", value<bool>(&cpmdremote.restart)->default_value(false),
+             "continue the cpmd run of the checkpoint file (same parameters otherwise)")
             ("np_shape,G", value<string>(&np_shape)->default_value("Sphere"), "nanoparticle shape")
+            ("operator_cache", value<string>(&operator_cache_dir)->default_value("opcache"),
+             "directory of the precalculated operator cache (none to disable)")
+            ("polarization_solver", value<string>(&polarization_solver)->default_value("cpmd"),
+             "induced charges from fictitious dynamics (cpmd) or solved at every step (cholesky, pcg)")
+            ("solver_tolerance", value<double>(&solver_tolerance)->default_value(1e-10),
+             "relative residual at which the pcg solver stops")
+            ("pair_kernel", value<string>(&pair_kernel)->default_value("auto"),
+             "ion - ion pair kernel: auto (widest supported), avx512, avx2 or scalar")
+            ("verlet_skin", value<double>(&neighbor_list.skin)->default_value(0.3),
+             "skin of the LJ neighbor list (reduced units); rebuilt when an ion moves half of it")
+            ("surface_field", value<string>(&surface_field)->default_value("direct"),
+             "field of the fixed interface charges on the ions: direct (sum over vertices) or table (interpolated away from the interface)")
+            ("surface_field_tolerance", value<double>(&surface_field_tolerance)->default_value(1e-5),
+             "largest interpolation error of the surface field table, relative to the field at the interface")
+            ("decomposition", value<string>(&decomposition_name)->default_value("1d"),
+             "ion - vertex work over the processes: 1d (vertex and ion ranges) or 2d (process grid over vertices x ions)")
+            ("output_queue", value<unsigned int>(&output_queue)->default_value(4096),
+             "records of the cpmd output files queued for the writer thread (0: written in the step loop)")
+            ("movie_format", value<string>(&movie_format)->default_value("float32"),
+             "movie of the ions: float32 or quantized (int16) binary trajectory outfiles/p.traj, converted by traj2lammpstrj, or lammpstrj (text outfiles/p.lammpstrj)")
+            ("movie_compression", value<bool>(&movie_compression)->default_value(false),
+             "deflate each frame of the binary trajectory")
+            ("series_chunk", value<unsigned int>(&series_chunk)->default_value(256),
+             "rows per chunk of the binary series (outfiles/*.series)")
+            ("series_text", value<bool>(&series_text)->default_value(true),
+             "also write the series as text files (energy.dat, temperature.dat, ...)")
+            ("density_analysis", value<bool>(&cpmdremote.density_analysis)->default_value(true),
+             "keep every density sample of every bin (outfiles/density_samples.series) for the autocorrelation and blocking analysis of the error bars at the end")
             ("verbose,I", value<bool>(&cpmdremote.verbose)->default_value(true),
              "verbose true: provides detailed output");
 
@@ -161,6 +218,31 @@ int main(int argc, char *argv[]) {
     if (world.rank() == 0)
         cout << "\nProgram starts\n";
 
+    if (!select_ion_pair_kernel(pair_kernel)) {
+        if (world.rank() == 0)
+            cout << "Ion pair kernel " << pair_kernel << " is unknown or not supported by this processor" << endl;
+        return 1;
+    }
+
+    if (!decomposition.set_mode(decomposition_name)) {
+        if (world.rank() == 0)
+            cout << "Unknown decomposition " << decomposition_name << " (use 1d or 2d)" << endl;
+        return 1;
+    }
+    decomposition.set_up(world);
+
+    if (movie_format != "float32" && movie_format != "quantized" && movie_format != "lammpstrj") {
+        if (world.rank() == 0)
+            cout << "Unknown movie format " << movie_format << " (use float32, quantized or lammpstrj)" << endl;
+        return 1;
+    }
+
+    if (cpmdremote.respa_steps < 1) {
+        if (world.rank() == 0)
+            cout << "The number of r-RESPA inner steps must be at least 1" << endl;
+        return 1;
+    }
+
     int numOfNodes = world.size();
     if (world.rank() == 0) {
 #pragma omp parallel default(shared)
@@ -171,6 +253,11 @@ int main(int argc, char *argv[]) {
                 printf("Number of OpenMP threads per MPI process %d\n", omp_get_num_threads());
                 printf("Make sure that number of grid points / ions is greater than %d\n",
                        omp_get_num_threads() * numOfNodes);
+                printf("Floating point precision %s\n", PRECISION_NAME);
+                printf("Ion pair kernel %s\n", ion_pair_kernel_name());
+                if (decomposition.mode == DECOMPOSITION_2D)
+                    printf("Ion - vertex work on a %u x %u process grid (vertices x ions)\n", decomposition.rows,
+                           decomposition.columns);
             }
         }
     }
@@ -180,26 +267,36 @@ int main(int argc, char *argv[]) {
         //Sphere
         vector<BinShell> bin_pos, bin_neg;
         vector<double> sample_density_pos, sample_density_neg;
-        NanoParticleSphere np("Sphere", bin_pos, bin_neg, bin_width_R, ion, sample_density_pos, sample_density_neg, 0,
-                              0, cpmdremote,
-                              np_pos, radius / unitlength, ein, eout,
-                              nanoparticle_bare_charge);
-
-        nanoParticle = &np;
+        // the nanoparticle lives until the end of the run (its density sums are sampled in cpmd)
+        nanoParticle = new NanoParticleSphere("Sphere", bin_pos, bin_neg, bin_width_R, ion, sample_density_pos,
+                                              sample_density_neg, 0, 0, cpmdremote,
+                                              np_pos, radius / unitlength, ein, eout,
+                                              nanoparticle_bare_charge);
 
     } else {
         //disk
 
         vector<vector<double> > density_pos, density_neg;
         vector<vector<BinRing> > bin_disk_pos, bin_disk_neg;
-        NanoParticleDisk np("Disk", bin_disk_pos, bin_disk_neg, bin_width_R, bin_width_Z, ion, density_pos, density_neg,
-                            0, 0, cpmdremote,
-                            np_pos, radius / unitlength, ein, eout,
-                            nanoparticle_bare_charge);
+        nanoParticle = new NanoParticleDisk("Disk", bin_disk_pos, bin_disk_neg, bin_width_R, bin_width_Z, ion,
+                                            density_pos, density_neg, 0, 0, cpmdremote,
+                                            np_pos, radius / unitlength, ein, eout,
+                                            nanoparticle_bare_charge);
 
-        nanoParticle = &np;
+    }
 
+    if (!nanoParticle->solver.set_mode(polarization_solver)) {
+        if (world.rank() == 0)
+            cout << "Unknown polarization solver " << polarization_solver << " (use cpmd, cholesky or pcg)" << endl;
+        return 1;
     }
+    nanoParticle->solver.tolerance = solver_tolerance;
+    if (!nanoParticle->surface_field.set_mode(surface_field)) {
+        if (world.rank() == 0)
+            cout << "Unknown surface field " << surface_field << " (use direct or table)" << endl;
+        return 1;
+    }
+    nanoParticle->surface_field.tolerance = surface_field_tolerance;
 
     // Set up the system
     real_T = 1;
@@ -225,6 +322,7 @@ int main(int argc, char *argv[]) {
     }*/
 
     nanoParticle->discretize(s,radius / unitlength);                                // discretize interface
+    nanoParticle->surface_field.set_up(s, nanoParticle->box_radius);                // field of the fixed charges
 
     // if dielectric environment inside and outside NP are different, NPs get polarized
     if (nanoParticle->ein == nanoParticle->eout)
@@ -241,19 +339,24 @@ int main(int argc, char *argv[]) {
 
     nanoParticle->RANDOMIZE_ION_FEATURES = false;
 
-    // NOTE: sizing the arrays employed in precalculate functions
-    for (unsigned int k = 0; k < s.size(); k++) {
-        s[k].presumgwEw.resize(s.size());
-        s[k].presumgEwEq.resize(s.size());
-        s[k].presumgEwEw.resize(s.size());
-        s[k].presumfwEw.resize(s.size());
-        s[k].presumfEwEq.resize(s.size());
-        s[k].presumhEqEw.resize(s.size());
+    //MPI Boundary calculation for meshPoints (needed by precalculate, which only builds the local rows)
+    unsigned int rangeMesh = s.size() / world.size() + 1.5;
+    lowerBoundMesh = world.rank() * rangeMesh;
+    upperBoundMesh = (world.rank() + 1) * rangeMesh - 1;
+    if (world.rank() == world.size() - 1)
+        upperBoundMesh = s.size() - 1;
+    if (world.size() == 1) {
+        lowerBoundMesh = 0;
+        upperBoundMesh = s.size() - 1;
     }
+    sizFVecMesh = upperBoundMesh - lowerBoundMesh + 1;
+    mesh_exchange.set_up(world, lowerBoundMesh, upperBoundMesh);
 
     // could only do precalculate if CPMD
-    if (nanoParticle->POLARIZED)
-        precalculate(s, nanoParticle);                        // precalculate
+    if (nanoParticle->POLARIZED) {
+        precalculate(s, nanoParticle, operator_cache_dir);                        // precalculate
+        nanoParticle->solver.set_up(nanoParticle->operators);
+    }
 
     for (unsigned int k = 0; k < s.size(); k++)               // get polar coordinates for the vertices
         s[k].get_polar();
@@ -309,56 +412,48 @@ int main(int argc, char *argv[]) {
                                   << setw(15) << "position" << setw(15) << ion[i].posvec << endl;
     initial_configuration.close();
 
-    // initial density
-    nanoParticle->compute_initial_density_profile();
-
     // some calculations before simulation begins
     if (world.rank() == 0)
         cout << "Total charge inside the sphere " << nanoParticle->total_charge_inside(ion) << endl;
 
-    // NEW NOTE : resizing the member arrays Gion and gradGion to store dynamic precalculations in fmd and cpmd force routines
-    for (unsigned int k = 0; k < s.size(); k++) {
-        s[k].Gion.resize(ion.size());
-        s[k].gradGion.resize(ion.size());
-    }
+    ion_arrays.load(ion);
 
-    //MPI Boundary calculation for ions
+    //MPI Boundary calculation for ions (numbered down the columns of the process grid in the 2d decomposition)
     unsigned int rangeIons = ion.size() / world.size() + 1.5;
-    lowerBoundIons = world.rank() * rangeIons;
-    upperBoundIons = (world.rank() + 1) * rangeIons - 1;
-    extraElementsIons = world.size() * rangeIons - ion.size();
-    sizFVecIons = upperBoundIons - lowerBoundIons + 1;
-    if (world.rank() == world.size() - 1) {
+    unsigned int ionPosition = decomposition.ion_position();
+    lowerBoundIons = ionPosition * rangeIons;
+    upperBoundIons = (ionPosition + 1) * rangeIons - 1;
+    if (ionPosition == (unsigned int) world.size() - 1)
         upperBoundIons = ion.size() - 1;
-        sizFVecIons = upperBoundIons - lowerBoundIons + 1 + extraElementsIons;
-    }
     if (world.size() == 1) {
         lowerBoundIons = 0;
         upperBoundIons = ion.size() - 1;
     }
+    sizFVecIons = upperBoundIons - lowerBoundIons + 1;
+    ion_exchange.set_up(world, lowerBoundIons, upperBoundIons);
+    decomposition.set_blocks(lowerBoundMesh, upperBoundMesh, lowerBoundIons, upperBoundIons);
 
-    //MPI Boundary calculation for meshPoints
-    unsigned int rangeMesh = s.size() / world.size() + 1.5;
-    lowerBoundMesh = world.rank() * rangeMesh;
-    upperBoundMesh = (world.rank() + 1) * rangeMesh - 1;
-    extraElementsMesh = world.size() * rangeMesh - s.size();
-    sizFVecMesh = upperBoundMesh - lowerBoundMesh + 1;
-    if (world.rank() == world.size() - 1) {
-        upperBoundMesh = s.size() - 1;
-        sizFVecMesh = upperBoundMesh - lowerBoundMesh + 1 + extraElementsMesh;
-    }
-    if (world.size() == 1) {
-        lowerBoundMesh = 0;
-        upperBoundMesh = s.size() - 1;
-    }
+    // initial density (binned by every process over its ions)
+    nanoParticle->compute_initial_density_profile();
 
     for (unsigned int k = 0; k < s.size(); k++) {
         s[k].w = 0.0;                                // Initialize fake degree value		(unconstrained)
         s[k].wmean = 0.0;
     }
 
-    // Fictitious molecular dynamics
-    if (nanoParticle->POLARIZED) {
+    // Fictitious molecular dynamics (the direct solvers need no warm-up: the first force evaluation solves for w);
+    // a restart takes the induced charges from the checkpoint instead
+    if (cpmdremote.restart) {
+        if (world.rank() == 0)
+            cout << "Restarting from the checkpoint " << cpmdremote.checkpoint_file << endl;
+    } else if (nanoParticle->POLARIZED && nanoParticle->solver.direct()) {
+        if (world.rank() == 0)
+            cout << "Polarized charges detected; induced charges will be solved for at every step ("
+                 << nanoParticle->solver.mode_name() << ")" << endl;
+        for_cpmd_calculate_force(s, ion, nanoParticle);
+        for (unsigned int k = 0; k < s.size(); k++)
+            s[k].wmean = s[k].w;
+    } else if (nanoParticle->POLARIZED) {
         if (world.rank() == 0)
             cout << "Polarized charges detected; simulation will proceed using dynamical optimization framework (CPMD)"
                  << endl;
@@ -388,7 +483,7 @@ int main(int argc, char *argv[]) {
     }
 
     vector<THERMOSTAT> fake_bath;
-    if (!nanoParticle->POLARIZED)
+    if (!nanoParticle->POLARIZED || nanoParticle->solver.direct())
         fake_T = 0;
 //K is used for thermostat fake_T is k
     if (chain_length_fake == 1)
@@ -406,19 +501,33 @@ int main(int argc, char *argv[]) {
     }
 
     // Car-Parrinello Molecular Dynamics
+    vector<string> density_columns;
+    if (cpmdremote.density_analysis)
+        nanoParticle->getDensityColumns(density_columns);
+    set_up_series(series_chunk, series_text, density_columns);
+    if (world.rank() == 0) {
+        output.start(output_queue);
+        if (movie_format != "lammpstrj") {
+            vector<int8_t> types(ion.size());
+            for (unsigned int i = 0; i < ion.size(); i++)
+                types[i] = ion[i].valency > 0 ? 1 : -1;
+            trajectory.set_up("outfiles/p.traj", movie_format == "quantized" ? TRAJECTORY_INT16 : TRAJECTORY_FLOAT32,
+                              movie_compression, nanoParticle->box_radius, types);
+        }
+    }
     cpmd(ion, s, nanoParticle, real_bath, fake_bath, fmdremote, cpmdremote);
 
     if (world.rank() == 0) {
         // Post simulation analysis (useful for short runs, but performed otherwise too)
         if (cpmdremote.verbose)
             cout << "MD trust factor R (should be < 0.05) is " << compute_MD_trust_factor_R(cpmdremote.hiteqm) << endl;
-        if (nanoParticle->POLARIZED && cpmdremote.verbose)
+        if (nanoParticle->POLARIZED && !nanoParticle->solver.direct() && cpmdremote.verbose)
             cout << "MD trust factor RV (should be < 0.15) is " << compute_MD_trust_factor_R_v(cpmdremote.hiteqm)
                  << endl;
-        //auto_correlation_function();
         cout << "Program ends" << endl;
         cout << endl;
     }
+    delete nanoParticle;
     return 0;
 }
 // End of main
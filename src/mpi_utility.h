@@ -5,6 +5,8 @@
 #ifndef _MPI_UTILITY_H
 #define _MPI_UTILITY_H
 
+#include "exchange.h"
+
 extern mpi::environment env;
 extern mpi::communicator world;
 
@@ -12,10 +14,12 @@ extern mpi::communicator world;
 extern unsigned int lowerBoundIons;
 extern unsigned int upperBoundIons;
 extern unsigned int sizFVecIons;
-extern unsigned int extraElementsIons;
 extern unsigned int lowerBoundMesh;
 extern unsigned int upperBoundMesh;
 extern unsigned int sizFVecMesh;
-extern unsigned int extraElementsMesh;
+
+// exchange of the per-process blocks of the vertices and of the ions
+extern Exchange mesh_exchange;
+extern Exchange ion_exchange;
 
 #endif
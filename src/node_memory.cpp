@@ -0,0 +1,72 @@
+// This file contains the node shared memory windows
+
+#include "node_memory.h"
+#include "mpi_utility.h"
+
+const mpi::communicator &node_communicator() {
+    static mpi::communicator node;
+    static bool made = false;
+    if (!made) {
+        MPI_Comm comm;
+        MPI_Comm_split_type(world, MPI_COMM_TYPE_SHARED, world.rank(), MPI_INFO_NULL, &comm);
+        node = mpi::communicator(comm, mpi::comm_take_ownership);
+        made = true;
+    }
+    return node;
+}
+
+static void *aligned(void *base) {
+    size_t address = (size_t) base;
+    return (void *) ((address + NODE_MEMORY_ALIGN - 1) / NODE_MEMORY_ALIGN * NODE_MEMORY_ALIGN);
+}
+
+void *NodeMemory::allocate(size_t bytes) {
+
+    release();
+    const mpi::communicator &node = node_communicator();
+
+    // separate segments let the library place each one on the memory of its own process
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, (char *) "alloc_shared_noncontig", (char *) "true");
+    void *base;
+    MPI_Win_allocate_shared(bytes + NODE_MEMORY_ALIGN, 1, info, node, &base, &window);
+    MPI_Info_free(&info);
+    local = aligned(base);
+
+    unsigned long mine = bytes, total;
+    MPI_Allreduce(&mine, &total, 1, MPI_UNSIGNED_LONG, MPI_SUM, node);
+    node_bytes = total;
+    return local;
+}
+
+void *NodeMemory::segment(int p) const {
+
+    MPI_Aint size;
+    int unit;
+    void *base;
+    MPI_Win_shared_query(window, p, &size, &unit, &base);
+    return aligned(base);
+}
+
+void NodeMemory::synchronize() const {
+
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, window);
+    MPI_Win_sync(window);
+    MPI_Barrier(node_communicator());
+    MPI_Win_sync(window);
+    MPI_Win_unlock_all(window);
+    return;
+}
+
+void NodeMemory::release() {
+
+    int finalized;
+    MPI_Finalized(&finalized);
+    if (window != MPI_WIN_NULL && !finalized)
+        MPI_Win_free(&window);
+    window = MPI_WIN_NULL;
+    local = NULL;
+    node_bytes = 0;
+    return;
+}
@@ -0,0 +1,56 @@
+// This is a header file for memory shared by the processes of a node
+// An MPI-3 shared memory window over the node communicator (MPI_Comm_split_type, MPI_COMM_TYPE_SHARED):
+// every process contributes a segment (possibly empty) and can read the segments of the other processes of
+// its node directly, so read-only data needs to be held only once per node.
+
+#ifndef _NODE_MEMORY_H
+#define _NODE_MEMORY_H
+
+#include "utility.h"
+
+// segments start on this boundary (bytes)
+const size_t NODE_MEMORY_ALIGN = 64;
+
+// the processes of world on this node
+const mpi::communicator &node_communicator();
+
+class NodeMemory {
+
+public:
+
+    NodeMemory() : window(MPI_WIN_NULL), local(NULL), node_bytes(0) {}
+
+    ~NodeMemory() {
+        release();
+    }
+
+    // collective over the node: the segment of this process, of the given size
+    void *allocate(size_t bytes);
+
+    // segment of process p of the node
+    void *segment(int p) const;
+
+    // memory of all segments of the node, in bytes
+    size_t bytes_on_node() const {
+        return node_bytes;
+    }
+
+    // collective over the node: the writes to the segments before it are seen by all processes after it
+    void synchronize() const;
+
+    // collective over the node
+    void release();
+
+private:
+
+    MPI_Win window;
+    void *local;
+    size_t node_bytes;
+
+    // the window is not copied
+    NodeMemory(const NodeMemory &);
+
+    NodeMemory &operator=(const NodeMemory &);
+};
+
+#endif
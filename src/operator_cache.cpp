@@ -0,0 +1,149 @@
+// This file contains the on-disk cache of precalculated interface operators
+
+#include "operator_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// layout: header, padding up to OPERATOR_CACHE_ALIGN, then CACHED_OPERATORS row-major N x N blocks
+const char OPERATOR_CACHE_MAGIC[8] = {'N', 'P', 'O', 'P', 'C', 'A', 'C', 'H'};
+const uint32_t OPERATOR_CACHE_VERSION = 1;
+const size_t OPERATOR_CACHE_ALIGN = 4096;
+
+struct OperatorCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t element_size;        // sizeof the stored floating point type
+    uint64_t key;
+    uint64_t N;
+    double radius;
+    int32_t shape_id;
+    uint32_t operators;
+    uint64_t data_offset;
+};
+
+// FNV-1a, 64 bit
+static uint64_t fnv1a(const char *data, size_t length, uint64_t hash) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+OperatorCache::OperatorCache() : map(NULL), map_size(0), data_offset(0), N(0) {}
+
+OperatorCache::~OperatorCache() {
+    close();
+}
+
+uint64_t OperatorCache::make_key(const string &grid_file, double radius, int shape_id) {
+
+    uint64_t hash = 14695981039346656037ULL;
+    ifstream in(grid_file.c_str(), ios::in | ios::binary);
+    char buffer[65536];
+    while (in) {
+        in.read(buffer, sizeof(buffer));
+        hash = fnv1a(buffer, in.gcount(), hash);
+    }
+
+    // the radius only enters the self term of H; key it at the precision the grid folders are named with.
+    // The vertex positions the operators are built from are held in the precision of the build.
+    char extra[160];
+    sprintf(extra, "|%.6f|%d|%u|%u|%s", radius, shape_id, (unsigned int) sizeof(long double), OPERATOR_CACHE_VERSION,
+            PRECISION_NAME);
+    return fnv1a(extra, strlen(extra), hash);
+}
+
+string OperatorCache::file_name(const string &cache_dir, uint64_t key) {
+    char name[64];
+    sprintf(name, "/operators_%016llx.bin", (unsigned long long) key);
+    return cache_dir + name;
+}
+
+bool OperatorCache::save(const string &path, uint64_t key, unsigned int N, double radius, int shape_id,
+                         const long double *const *ops) {
+
+    OperatorCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, OPERATOR_CACHE_MAGIC, sizeof(header.magic));
+    header.version = OPERATOR_CACHE_VERSION;
+    header.element_size = sizeof(long double);
+    header.key = key;
+    header.N = N;
+    header.radius = radius;
+    header.shape_id = shape_id;
+    header.operators = CACHED_OPERATORS;
+    header.data_offset = OPERATOR_CACHE_ALIGN;
+
+    char suffix[32];
+    sprintf(suffix, ".tmp%d", (int) getpid());
+    string temporary = path + suffix;
+    ofstream out(temporary.c_str(), ios::out | ios::binary | ios::trunc);
+    if (!out)
+        return false;
+    out.write((const char *) &header, sizeof(header));
+    vector<char> padding(OPERATOR_CACHE_ALIGN - sizeof(header), 0);
+    out.write(&padding[0], padding.size());
+    for (unsigned int op = 0; op < CACHED_OPERATORS; op++)
+        out.write((const char *) ops[op], sizeof(long double) * N * N);
+    out.close();
+    if (!out) {
+        remove(temporary.c_str());
+        return false;
+    }
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+bool OperatorCache::open(const string &path, uint64_t key, unsigned int size) {
+
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    OperatorCacheHeader header;
+    bool valid = fstat(fd, &info) == 0 && info.st_size >= (off_t) sizeof(header) &&
+                 pread(fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header);
+    valid = valid && memcmp(header.magic, OPERATOR_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+            header.version == OPERATOR_CACHE_VERSION && header.element_size == sizeof(long double) &&
+            header.key == key && header.N == size && header.operators == CACHED_OPERATORS &&
+            (size_t) info.st_size >= header.data_offset + CACHED_OPERATORS * sizeof(long double) * size * size;
+    if (!valid) {
+        ::close(fd);
+        return false;
+    }
+
+    map_size = info.st_size;
+    map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        map_size = 0;
+        return false;
+    }
+    data_offset = header.data_offset;
+    N = size;
+    return true;
+}
+
+const long double *OperatorCache::op(unsigned int which) const {
+    return (const long double *) ((const char *) map + data_offset) + (size_t) which * N * N;
+}
+
+void OperatorCache::close() {
+    if (map != NULL)
+        munmap(map, map_size);
+    map = NULL;
+    map_size = 0;
+    N = 0;
+    return;
+}
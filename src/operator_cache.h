@@ -0,0 +1,55 @@
+// This is a header file for the on-disk cache of precalculated interface operators
+// The operators depend only on the grid file, the radius and the shape, so they are shared by every run on that mesh
+
+#ifndef _OPERATOR_CACHE_H
+#define _OPERATOR_CACHE_H
+
+#include <stdint.h>
+#include <string>
+#include "precision.h"
+
+using namespace std;
+
+// dense N x N operators held in a cache file, in this order
+enum CACHED_OPERATOR {
+    CACHED_GREENS = 0,            // G(k,l)
+    CACHED_NDOTGRADGREENS = 1,    // H(l,k), row k is the ndotGradGreens row of vertex k
+    CACHED_P = 2,                 // G diag(a) H^T
+    CACHED_Q = 3,                 // H diag(a) P
+    CACHED_OPERATORS = 4
+};
+
+class OperatorCache {
+
+public:
+
+    OperatorCache();
+
+    ~OperatorCache();
+
+    // key of a mesh: hash of the grid file contents, the radius and the shape
+    static uint64_t make_key(const string &, double, int);
+
+    // cache file for a key inside the cache directory
+    static string file_name(const string &, uint64_t);
+
+    // write the operators of a mesh to a cache file (written to a temporary file, then renamed)
+    static bool save(const string &, uint64_t, unsigned int, double, int, const long double *const *);
+
+    // map a cache file read-only; false if it is missing or does not match the key and size
+    bool open(const string &, uint64_t, unsigned int);
+
+    // pointer to one mapped N x N operator (row-major)
+    const long double *op(unsigned int) const;
+
+    void close();
+
+private:
+
+    void *map;
+    size_t map_size;
+    size_t data_offset;
+    unsigned int N;
+};
+
+#endif
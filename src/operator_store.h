@@ -0,0 +1,113 @@
+// This is a header file for the store of precalculated interface operators
+// Every operator is held once, as aligned row-major rows lowerBoundMesh..upperBoundMesh of one allocation,
+// which is the segment of the process in a node shared memory window (see node_memory.h)
+
+#ifndef _OPERATOR_STORE_H
+#define _OPERATOR_STORE_H
+
+#include <cstddef>
+#include <cstring>
+#include "precision.h"
+#include "node_memory.h"
+
+// operators held in the store. With P = G diag(a) H^T and Q = H diag(a) P, the presum operators of the
+// force and energy routines are fwEw = fEwEq = hEqEw = P, gEwEq = P^T, gwEw = P + P^T and gEwEw = Q.
+// Their em/ed coefficients are constant for a run, so they are folded once into effective operators:
+//      Kww  = -em(em-1) G + 0.5 ed(2em-1) (P + P^T) - ed^2 Q        (gww + gwEw + gEwEw, on w a)
+//      KwEq =  0.5 ed(2em-1) G - ed^2 P^T                           (gwEq + gEwEq, on the ion field)
+//      Kh   =  0.5 ed(2em-1) G - ed^2 P                             (hEqw + hEqEw, on w a)
+enum INTERFACE_OPERATOR {
+    OP_GREENS = 0,                // G(k,l)
+    OP_NDOTGRADGREENS = 1,        // n.gradG, H(l,k)
+    OP_KWW = 2,
+    OP_KWEQ = 3,
+    OP_KH = 4,
+    INTERFACE_OPERATORS = 5
+};
+
+// rows start on this boundary (bytes) so that the streaming loops see aligned cache lines
+const size_t OPERATOR_STORE_ALIGN = NODE_MEMORY_ALIGN;
+
+// T is the storage type of the operators (OPERATOR_REAL of the precision policy)
+template<typename T>
+class OperatorStore_T {
+
+public:
+
+    unsigned int N;            // number of vertices (columns)
+    unsigned int lower;        // first row held
+    unsigned int upper;        // last row held
+    size_t stride;            // distance between rows in elements (N padded to the alignment)
+
+    OperatorStore_T() : N(0), lower(0), upper(0), stride(0), rows(0), data(NULL) {}
+
+    ~OperatorStore_T() {
+        release();
+    }
+
+    // room for rows first..last of every operator on a mesh of size vertices (collective over the node)
+    void allocate(unsigned int size, unsigned int first, unsigned int last) {
+        release();
+        N = size;
+        lower = first;
+        upper = last;
+        rows = last - first + 1;
+        size_t per_line = OPERATOR_STORE_ALIGN / sizeof(T);
+        stride = (N + per_line - 1) / per_line * per_line;
+
+        data = (T *) memory.allocate(bytes());
+        memset(data, 0, bytes());
+        return;
+    }
+
+    void release() {
+        memory.release();
+        data = NULL;
+        rows = 0;
+        return;
+    }
+
+    // memory held, in bytes
+    size_t bytes() const {
+        return (size_t) INTERFACE_OPERATORS * rows * stride * sizeof(T);
+    }
+
+    // memory held by the stores of all processes of the node, in bytes
+    size_t node_bytes() const {
+        return memory.bytes_on_node();
+    }
+
+    // row k (global vertex index) of an operator
+    T *row(unsigned int op, unsigned int k) {
+        return data + ((size_t) op * rows + (k - lower)) * stride;
+    }
+
+    const T *row(unsigned int op, unsigned int k) const {
+        return data + ((size_t) op * rows + (k - lower)) * stride;
+    }
+
+    const T *greens(unsigned int k) const { return row(OP_GREENS, k); }
+
+    const T *ndotGradGreens(unsigned int k) const { return row(OP_NDOTGRADGREENS, k); }
+
+    const T *Kww(unsigned int k) const { return row(OP_KWW, k); }
+
+    const T *KwEq(unsigned int k) const { return row(OP_KWEQ, k); }
+
+    const T *Kh(unsigned int k) const { return row(OP_KH, k); }
+
+private:
+
+    unsigned int rows;
+    T *data;
+    NodeMemory memory;
+
+    // the store owns its memory; it is not copied
+    OperatorStore_T(const OperatorStore_T &);
+
+    OperatorStore_T &operator=(const OperatorStore_T &);
+};
+
+typedef OperatorStore_T<OPERATOR_REAL> OperatorStore;
+
+#endif
@@ -0,0 +1,157 @@
+// This file contains the output manager of the step loops
+
+#include "output.h"
+
+#include <chrono>
+
+using namespace std;
+
+OutputManager::OutputManager() : queued(0), late(0), dropped(0), largest_depth(0), head(0), tail(0), flushed(0),
+                                 running(false), idle(false) {}
+
+OutputManager::~OutputManager() {
+    stop();
+}
+
+void OutputManager::start(size_t depth) {
+
+    if (running || depth == 0)
+        return;
+    ring.assign(depth, RECORD());
+    head = tail = flushed = 0;
+    running = true;
+    writer = thread(&OutputManager::run, this);
+    return;
+}
+
+void OutputManager::append(const string &path, const string &text) {
+    queue(false, path, text);
+}
+
+void OutputManager::write(const string &path, const string &text) {
+    queue(true, path, text);
+}
+
+void OutputManager::queue(bool whole, const string &path, const string &text) {
+
+    if (!running) {
+        RECORD record = {whole, path, text};
+        if (!write_record(record, false))
+            dropped++;
+        return;
+    }
+
+    size_t t = tail.load(memory_order_relaxed);
+    if (t - head.load(memory_order_acquire) == ring.size()) {
+        late++;
+        while (t - head.load(memory_order_acquire) == ring.size()) {
+            wake.notify_one();
+            this_thread::yield();
+        }
+    }
+    RECORD &record = ring[t % ring.size()];
+    record.whole = whole;
+    record.path = path;
+    record.text = text;
+    tail.store(t + 1, memory_order_release);
+    queued++;
+    size_t in_ring = t + 1 - head.load(memory_order_relaxed);
+    if (in_ring > largest_depth)
+        largest_depth = in_ring;
+    if (idle.load()) {
+        // the writer thread is waiting (or about to): notified under its lock, the wake up is not lost
+        lock_guard<mutex> lock(wake_lock);
+        wake.notify_one();
+    }
+    return;
+}
+
+void OutputManager::run() {
+
+    while (true) {
+        size_t h = head.load(memory_order_relaxed);
+        if (h != tail.load(memory_order_acquire)) {
+            RECORD &record = ring[h % ring.size()];
+            if (!write_record(record, true))
+                dropped++;
+            record.text.clear();
+            head.store(h + 1, memory_order_release);
+            continue;
+        }
+
+        // the ring is empty: the records so far go to the file system
+        if (flushed.load(memory_order_relaxed) != h) {
+            for (map<string, ofstream *>::iterator f = files.begin(); f != files.end(); f++)
+                f->second->flush();
+            flushed.store(h, memory_order_release);
+        }
+        if (!running.load())
+            break;
+
+        unique_lock<mutex> lock(wake_lock);
+        idle = true;
+        if (tail.load(memory_order_acquire) == h && running.load())
+            wake.wait_for(lock, chrono::milliseconds(10));
+        idle = false;
+    }
+    return;
+}
+
+bool OutputManager::write_record(const RECORD &record, bool keep_open) {
+
+    if (record.whole) {
+        ofstream out(record.path.c_str(), ios::out);
+        out << record.text;
+        out.close();
+        return !out.fail();
+    }
+
+    if (!keep_open) {
+        ofstream out(record.path.c_str(), ios::app);
+        out << record.text;
+        out.close();
+        return !out.fail();
+    }
+
+    ofstream *&out = files[record.path];
+    if (out == NULL)
+        out = new ofstream(record.path.c_str(), ios::app);
+    *out << record.text;
+    if (out->fail()) {
+        out->clear();
+        return false;
+    }
+    return true;
+}
+
+void OutputManager::flush() {
+
+    if (!running)
+        return;
+    size_t t = tail.load(memory_order_relaxed);
+    while (flushed.load(memory_order_acquire) < t) {
+        wake.notify_one();
+        this_thread::yield();
+    }
+    return;
+}
+
+void OutputManager::stop() {
+
+    if (!running)
+        return;
+    flush();
+    running = false;
+    wake.notify_one();
+    writer.join();
+    close_files();
+    return;
+}
+
+void OutputManager::close_files() {
+
+    for (map<string, ofstream *>::iterator f = files.begin(); f != files.end(); f++)
+        delete f->second;
+    files.clear();
+    return;
+}
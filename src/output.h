@@ -0,0 +1,87 @@
+// This is a header file for the output of the step loops
+// The records of the text files written in the cpmd step loop are formatted by the caller and queued (on the first
+// process, which writes the files) into a single producer, single consumer ring: the two ends are atomic counters,
+// so queueing takes no lock. A writer thread drains the ring into the files, which it keeps open and flushes when
+// the ring runs empty, so the step loop does not wait for the file system. A record that finds the ring full waits
+// for room and is counted late; a record that cannot be written is counted dropped.
+// Without the writer thread (depth 0, other processes, or after stop) the caller writes the records itself.
+
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class OutputManager {
+
+public:
+
+    unsigned long queued;           // records queued
+    unsigned long late;             // records that waited for room in the ring
+    unsigned long dropped;          // records that could not be written
+    size_t largest_depth;           // most records in the ring at once
+
+    OutputManager();
+
+    ~OutputManager();
+
+    // the writer thread, with a ring of depth records (0: the caller writes)
+    void start(size_t depth);
+
+    size_t depth() const {
+        return ring.size();
+    }
+
+    // text appended to the file at path
+    void append(const std::string &path, const std::string &text);
+
+    // text written as the whole file at path
+    void write(const std::string &path, const std::string &text);
+
+    // returns once the records queued so far are written and flushed
+    void flush();
+
+    // flushes, ends the writer thread and closes the files
+    void stop();
+
+private:
+
+    struct RECORD {
+        bool whole;                 // write the whole file rather than append
+        std::string path, text;
+    };
+
+    std::vector<RECORD> ring;
+    std::atomic<size_t> head;       // records taken by the writer thread so far
+    std::atomic<size_t> tail;       // records queued so far
+    std::atomic<size_t> flushed;    // records written and flushed so far
+    std::atomic<bool> running, idle;
+    std::thread writer;
+    std::mutex wake_lock;
+    std::condition_variable wake;
+    std::map<std::string, std::ofstream *> files;      // files of the appends, kept open by the writer thread
+
+    void queue(bool whole, const std::string &path, const std::string &text);
+
+    void run();
+
+    // false if the record could not be written; keep_open keeps the file of an append open (writer thread)
+    bool write_record(const RECORD &, bool keep_open);
+
+    void close_files();
+
+    // the manager is not copied
+    OutputManager(const OutputManager &);
+
+    OutputManager &operator=(const OutputManager &);
+};
+
+extern OutputManager output;
+
+#endif
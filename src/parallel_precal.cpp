@@ -1,92 +1,197 @@
 // This routine sets up and performs precalculations
 
 #include "precalculations.h"
+#include "blocked_gemm.h"
+#include "operator_cache.h"
+#include <sys/stat.h>
 
-void precalculate(vector<VERTEX> &s, NanoParticle *nanoParticle) {
-    
-    
+// All presum operators are products of the form G diag(a) H. With H(k,l) stored densely as Hm[k][l]:
+//      P = G diag(a) Hm^T      ->  fwEw = fEwEq = hEqEw = P,  gEwEq = P^T,  gwEw = P + P^T
+//      Q = Hm diag(a) P        ->  gEwEw = Q  (the old serial 'inner' pre-pass is exactly P)
+// so two blocked matrix multiplies replace the O(N^3) triple loops over G() and H().
+// Each process of comm computes rows lower..upper of G, H^T, P and Q; Hm and P are needed in full
+// (as right operands and for P^T), so their rows are exchanged with all_gather instead of recomputed.
+void build_interface_operators(const mpi::communicator &comm, vector<VERTEX> &s, double radius, unsigned int lower,
+                               unsigned int upper, vector<long double> &Gd, vector<long double> &HT,
+                               vector<long double> &P, vector<long double> &Q) {
 
-    if (world.rank() == 0)
-        cout << "Precalculations..." << endl;
+    unsigned int N = s.size();
+    unsigned int rows = upper - lower + 1;
+    int nsize = N;
+    int nrows = rows;
+    Exchange row_blocks;
+    row_blocks.set_up(comm, lower, upper);
+    vector<long double> Hm(N * N), Hm_rows(rows * N, 0.0), P_rows(rows * N, 0.0), B(N * N);
+    Gd.assign(rows * N, 0.0);
+    HT.assign(rows * N, 0.0);
+    Q.assign(rows * N, 0.0);
+    P.assign(N * N, 0.0);
 
-    for (unsigned int k = 0; k < s.size(); k++) {
-        for (unsigned int l = 0; l < s.size(); l++)
-            s[k].Greens.push_back(G(s, k, l));
+    // local rows of G and H
+#pragma omp parallel for schedule(dynamic) default(shared)
+    for (int k = 0; k < nrows; k++) {
+        for (unsigned int l = 0; l < N; l++) {
+            Gd[k * N + l] = G(s, lower + k, l);
+            Hm_rows[k * N + l] = H(s, lower + k, l, radius);
+        }
     }
-    for (unsigned int k = 0; k < s.size(); k++) {
-        for (unsigned int l = 0; l < s.size(); l++)
-            s[k].ndotGradGreens.push_back(H(s, l, k, nanoParticle->radius));
+    row_blocks.all_gather(&Hm_rows[0], &Hm[0], N);
+
+    // B = diag(a) Hm^T is the right operand of the first product
+#pragma omp parallel for schedule(static) default(shared)
+    for (int l = 0; l < nsize; l++)
+        for (unsigned int m = 0; m < N; m++)
+            B[l * N + m] = s[l].a * Hm[m * N + l];
+#pragma omp parallel for schedule(static) default(shared)
+    for (int k = 0; k < nrows; k++)
+        for (unsigned int m = 0; m < N; m++)
+            HT[k * N + m] = Hm[m * N + lower + k];
+
+    // local rows of P = G diag(a) Hm^T, then all of P
+    blocked_gemm(rows, N, N, &Gd[0], N, &B[0], N, &P_rows[0], N);
+    row_blocks.all_gather(&P_rows[0], &P[0], N);
+
+    // local rows of Q = Hm diag(a) P  (B is reused for diag(a) P)
+#pragma omp parallel for schedule(static) default(shared)
+    for (int l = 0; l < nsize; l++)
+        for (unsigned int m = 0; m < N; m++)
+            B[l * N + m] = s[l].a * P[l * N + m];
+    blocked_gemm(rows, N, N, &Hm[lower * N], N, &B[0], N, &Q[0], N);
+
+    // spot check a few local entries against the direct sums over G() and H()
+    long double max_deviation = 0;
+    for (unsigned int sample = 0; sample < 4; sample++) {
+        unsigned int k = lower + (sample * 7919) % rows;
+        unsigned int m = (sample * 104729 + N / 2) % N;
+        long double gwEw = 0, gEwEq = 0, gEwEw = 0;
+        for (unsigned int l = 0; l < N; l++) {
+            gwEw += (H(s, k, l, radius) * G(s, m, l) + G(s, k, l) * H(s, m, l, radius)) * s[l].a;
+            gEwEq += H(s, k, l, radius) * G(s, m, l) * s[l].a;
+            long double inner = 0;
+            for (unsigned int n = 0; n < N; n++)
+                inner += G(s, l, n) * H(s, m, n, radius) * s[n].a;
+            gEwEw += H(s, k, l, radius) * inner * s[l].a;
+        }
+        long double engine_gwEw = P[k * N + m] + P[m * N + k];
+        max_deviation = max(max_deviation, fabsl(gwEw - engine_gwEw) / max(fabsl(gwEw), 1e-30L));
+        max_deviation = max(max_deviation, fabsl(gEwEq - P[m * N + k]) / max(fabsl(gEwEq), 1e-30L));
+        max_deviation = max(max_deviation, fabsl(gEwEw - Q[(k - lower) * N + m]) / max(fabsl(gEwEw), 1e-30L));
     }
-    //if (world.rank() == 0)
-    //    cout << "Next, one inner loop computation for gEwEw" << endl;
-
-    // this will be a serial computation
-    vector<vector<long double> > inner(s.size() * s.size());
-    vector<long double> row(s.size(), 0.0);
-    unsigned int k, m, l, n;
-    long double gwEw, gEwEq, gEwEw, fwEw, fEwEq, pre_gEwEw;
-
-    for (l = 0; l < s.size(); l++) {
-        for (n = 0; n < s.size(); n++) {
-            pre_gEwEw = 0;
-            for (m = 0; m < s.size(); m++)
-                pre_gEwEw += G(s, l, m) * H(s, n, m, nanoParticle->radius) * s[m].a;
-            row[n] = pre_gEwEw;
+    double deviation = max_deviation;
+    if (comm.size() > 1)
+        deviation = all_reduce(comm, deviation, mpi::maximum<double>());
+
+    if (comm.rank() == 0)
+        cout << "Maximum relative deviation of sampled operator entries from direct sums " << deviation << endl;
+    return;
+}
+
+// setup stage: fill the operator store with rows lower..upper for the force and energy routines on this process,
+// folding the em/ed coefficients of the run into the effective operators Kww, KwEq and Kh (see operator_store.h)
+// and converting to the storage precision; Grows, HTrows and Qrows start at row lower, P is the full operator
+// (its columns are the rows of P^T)
+static void combine_interface_operators(OperatorStore &store, NanoParticle *nanoParticle, unsigned int N,
+                                        unsigned int lower, unsigned int upper, const long double *Grows,
+                                        const long double *HTrows, const long double *P, const long double *Qrows) {
+
+    long double em = nanoParticle->em;
+    long double ed = nanoParticle->ed;
+    long double cG = -em * (em - 1);
+    long double cP = 0.5 * ed * (2 * em - 1);
+    long double cQ = -ed * ed;
+
+    store.allocate(N, lower, upper);
+    int nrows = upper - lower + 1;
+#pragma omp parallel for schedule(static) default(shared)
+    for (int r = 0; r < nrows; r++) {
+        unsigned int k = lower + r;
+        OPERATOR_REAL *Gk = store.row(OP_GREENS, k);
+        OPERATOR_REAL *Hk = store.row(OP_NDOTGRADGREENS, k);
+        OPERATOR_REAL *Kwwk = store.row(OP_KWW, k);
+        OPERATOR_REAL *KwEqk = store.row(OP_KWEQ, k);
+        OPERATOR_REAL *Khk = store.row(OP_KH, k);
+        for (unsigned int m = 0; m < N; m++) {
+            long double Gkm = Grows[r * N + m];
+            long double Pkm = P[k * N + m];
+            long double Pmk = P[m * N + k];
+            Gk[m] = Gkm;
+            Hk[m] = HTrows[r * N + m];
+            Kwwk[m] = cG * Gkm + cP * (Pkm + Pmk) + cQ * Qrows[r * N + m];
+            KwEqk[m] = cP * Gkm + cQ * Pmk;
+            Khk[m] = cP * Gkm + cQ * Pkm;
         }
-        inner[l] = row;
     }
-    //if (world.rank() == 0)
-    //    cout << "Precalculate gwEw, gEwEq, gEwEw, fwEw, fEwEq in parallel" << endl;
-
-    // parallel computation
-#pragma omp parallel default(shared) private(k, m, l, gwEw, gEwEq, gEwEw, fwEw, fEwEq)
-    {
-#pragma omp for schedule(dynamic) nowait
-        for (k = 0; k < s.size(); k++) {
-            for (m = 0; m < s.size(); m++) {
-                // gwEw
-                gwEw = 0;
-                for (l = 0; l < s.size(); l++)
-                    gwEw += (H(s, k, l, nanoParticle->radius) * G(s, m, l) +
-                             G(s, k, l) * H(s, m, l, nanoParticle->radius)) * s[l].a;
-                s[k].presumgwEw[m] = gwEw;
-
-                // gEwEq
-                gEwEq = 0;
-                for (l = 0; l < s.size(); l++)
-                    gEwEq += (H(s, k, l, nanoParticle->radius) * G(s, m, l)) * s[l].a;
-                s[k].presumgEwEq[m] = gEwEq;
-
-                // gEwEw
-                gEwEw = 0;
-                for (l = 0; l < s.size(); l++)
-                    gEwEw += H(s, k, l, nanoParticle->radius) * inner[l][m] *
-                             s[l].a;        // NOTE the switch from n to m
-                s[k].presumgEwEw[m] = gEwEw;
-
-                // fwEw
-                fwEw = 0;
-                for (l = 0; l < s.size(); l++)
-                    fwEw += G(s, k, l) * H(s, m, l, nanoParticle->radius) * s[l].a;
-                s[k].presumfwEw[m] = fwEw;
-
-                // fEwEq
-                fEwEq = 0;
-                for (l = 0; l < s.size(); l++)
-                    fEwEq += G(s, k, l) * H(s, m, l, nanoParticle->radius) * s[l].a;
-                s[k].presumfEwEq[m] = fEwEq;
-            }
+
+    if (world.rank() == 0)
+        cout << "Interface operator store holds " << store.node_bytes() / 1048576.0 << " MB per node ("
+             << store.bytes() / 1048576.0 << " MB on this process, in node shared memory)" << endl;
+    return;
+}
+
+// the force and energy routines only read operator rows lowerBoundMesh..upperBoundMesh,
+// so each process builds (or loads) just those rows
+void precalculate(vector<VERTEX> &s, NanoParticle *nanoParticle, const string &cache_dir) {
+
+    if (world.rank() == 0)
+        cout << "Precalculations..." << endl;
+
+    double start_time = omp_get_wtime();
+    unsigned int N = s.size();
+
+    // the operators depend only on the mesh (grid file, radius, shape); try the on-disk cache first
+    bool use_cache = !cache_dir.empty() && cache_dir != "none";
+    uint64_t key = 0;
+    string cache_file;
+    if (use_cache) {
+        key = OperatorCache::make_key(nanoParticle->grid_filename(nanoParticle->radius), nanoParticle->radius,
+                                      nanoParticle->shape_id);
+        cache_file = OperatorCache::file_name(cache_dir, key);
+        OperatorCache cache;
+        int opened = cache.open(cache_file, key, N);
+        // all processes must take the same path, or the collectives below would not match
+        if (world.size() > 1)
+            opened = all_reduce(world, opened, mpi::minimum<int>());
+        if (opened) {
+            size_t offset = (size_t) lowerBoundMesh * N;
+            combine_interface_operators(nanoParticle->operators, nanoParticle, N, lowerBoundMesh, upperBoundMesh,
+                                        cache.op(CACHED_GREENS) + offset, cache.op(CACHED_NDOTGRADGREENS) + offset,
+                                        cache.op(CACHED_P), cache.op(CACHED_Q) + offset);
+            if (world.rank() == 0)
+                cout << "Interface operators loaded from cache " << cache_file << " in "
+                     << 1000 * (omp_get_wtime() - start_time) << " ms" << endl;
+            return;
         }
     }
 
-    // hEqEw is the same as fEwEq
-    for (unsigned int k = 0; k < s.size(); k++) {
-        for (unsigned int m = 0; m < s.size(); m++) {
-            s[k].presumhEqEw[m] = s[k].presumfEwEq[m];
+    vector<long double> Gd, HT, P, Q;
+    build_interface_operators(world, s, nanoParticle->radius, lowerBoundMesh, upperBoundMesh, Gd, HT, P, Q);
+    combine_interface_operators(nanoParticle->operators, nanoParticle, N, lowerBoundMesh, upperBoundMesh, &Gd[0],
+                                &HT[0], &P[0], &Q[0]);
+
+    if (world.rank() == 0)
+        cout << "Precalculation (blocked GEMM engine, " << world.size() << " processes x " << omp_get_max_threads()
+             << " threads) took " << omp_get_wtime() - start_time << " s" << endl;
+
+    if (use_cache) {
+        // the cache holds full operators: collect the row blocks on the writing process
+        vector<long double> Gfull, HTfull, Qfull;
+        if (world.rank() == 0) {
+            Gfull.resize((size_t) N * N);
+            HTfull.resize((size_t) N * N);
+            Qfull.resize((size_t) N * N);
+        }
+        mesh_exchange.gather(&Gd[0], Gfull.data(), N, 0);
+        mesh_exchange.gather(&HT[0], HTfull.data(), N, 0);
+        mesh_exchange.gather(&Q[0], Qfull.data(), N, 0);
+        if (world.rank() == 0) {
+            mkdir(cache_dir.c_str(), 0755);
+            const long double *ops[CACHED_OPERATORS] = {&Gfull[0], &HTfull[0], &P[0], &Qfull[0]};
+            if (OperatorCache::save(cache_file, key, N, nanoParticle->radius, nanoParticle->shape_id, ops))
+                cout << "Interface operators written to cache " << cache_file << endl;
+            else
+                cout << "Could not write the operator cache " << cache_file << endl;
         }
     }
-    inner.clear();
 
     return;
 }
-
@@ -44,7 +44,7 @@ class PARTICLE
   VECTOR3D forvec;	// force vector on the particle
   double pe;		// potential energy
   double electrostaticPE;  // the ES component of the PE
-  long double ke;	// kinetic energy
+  REAL ke;	// kinetic energy
   double energy;	// energy
   
   // member functions
@@ -75,7 +75,7 @@ class PARTICLE
     return;
   }
   
-  void new_update_velocity(double dt, THERMOSTAT main_bath, long double expfac)
+  void new_update_velocity(double dt, THERMOSTAT main_bath, REAL expfac)
   {
     velvec = ( ( velvec ^ (expfac)  ) + ( forvec ^ (0.5 * dt * sqrt(expfac)) ) );
     return;
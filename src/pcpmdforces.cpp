@@ -4,9 +4,28 @@
 
 #include "forces.h"
 
-// Total Force on all degrees of freedom
-void
-for_cpmd_calculate_force(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle *nanoParticle) {
+// terms of the ions lowerBoundIons..upperBoundIons that need none of the interface sums: the ion - ion Coulomb
+// sums and the potential and field of the fixed charges realQ (tabulated away from the interface)
+static void ion_fixed_terms(vector<PARTICLE> &ion, NanoParticle *nanoParticle, vector<ION_PAIR_SUMS> &pairs,
+                            vector<REAL> &fqQ, vector<VECTOR3D> &EQ) {
+    int n = upperBoundIons - lowerBoundIons + 1;
+#pragma omp parallel for schedule(dynamic) default(shared)
+    for (int r = 0; r < n; r++) {
+        ion_pair_sums(ion_arrays, lowerBoundIons + r, pairs[r]);
+        nanoParticle->surface_field.evaluate(ion[lowerBoundIons + r].posvec, fqQ[r], EQ[r]);
+        // the master thread lets MPI advance the interface exchange in flight meanwhile
+        if (omp_get_thread_num() == 0)
+            mesh_exchange.progress();
+    }
+    return;
+}
+
+// Total Force on all degrees of freedom; with_energy also gives the potential energy (returned) and the
+// electrostatic energy of each ion from the same sweep, equal to what energy_functional computes for this state
+// with_short_range = false leaves the LJ forces (and energy) out, for the outer steps of r-RESPA
+double
+for_cpmd_calculate_force(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle *nanoParticle, bool with_energy,
+                         bool with_short_range) {
 
     // force calculation for fake degrees of freedom
     // gwq : force due to induced charge (w) - ion (q) interaction
@@ -33,220 +52,223 @@ for_cpmd_calculate_force(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle
 
     //Common MPI Message objects
     vector<VECTOR3D> forvec(sizFVecIons, VECTOR3D(0, 0, 0));
-    vector<VECTOR3D> lj1(sizFVecIons, VECTOR3D(0, 0, 0));
-    vector<VECTOR3D> lj2(sizFVecIons, VECTOR3D(0, 0, 0));
-    vector<VECTOR3D> lj3(sizFVecIons, VECTOR3D(0, 0, 0));
-    vector<VECTOR3D> lj4(sizFVecIons, VECTOR3D(0, 0, 0));
-    vector<VECTOR3D> forvecGather(ion.size() + extraElementsIons, VECTOR3D(0, 0, 0));
+    vector<VECTOR3D> lj(sizFVecIons, VECTOR3D(0, 0, 0));
+    vector<VECTOR3D> forvecGather(ion.size(), VECTOR3D(0, 0, 0));
+    vector<double> ion_energy(sizFVecIons, 0.0);
+    double ind_ind = 0;
+    double lj_energy = 0;
 
-    unsigned int iloop, j1;
+    unsigned int iloop;
 
 
     if (nanoParticle->POLARIZED) {
         // declarations (necessary beforehand for parallel implementation)
-        long double gwq, gww_wEw_EwEw, gEwq, gwEq, gwEq_EwEq;
-        long double hqEw, hqEq, hEqw, hEqEq, hEqEw;
-        unsigned int kloop, l1, i1;
-
-        long double insum;
+        REAL gwq;
+        REAL hqEq;
+        unsigned int kloop, l1;
 
         VECTOR3D h0, h1, h2, h3;
 
+        const OperatorStore &operators = nanoParticle->operators;
+
         /////////////POLARIZED only MPI Message objects
-        vector<long double> saveinsum(sizFVecMesh, 0.0);
-        vector<long double> saveinsumGather(s.size() + extraElementsMesh, 0.0);
-        vector<long double> innerg3(sizFVecMesh, 0.0);
-        vector<long double> innerg3Gather(s.size() + extraElementsMesh, 0.0);
-        vector<long double> innerg4(sizFVecMesh, 0.0);
-        vector<long double> innerg4Gather(s.size() + extraElementsMesh, 0.0);
-        vector<long double> innerh2(sizFVecMesh, 0.0);
-        vector<long double> innerh2Gather(s.size() + extraElementsMesh, 0.0);
-        vector<long double> innerh4(sizFVecMesh, 0.0);
-        vector<long double> innerh4Gather(s.size() + extraElementsMesh, 0.0);
-        vector<long double> fw(sizFVecMesh, 0.0);
-        vector<long double> fwGather(s.size() + extraElementsMesh, 0.0);
+        vector<REAL> innerg3(sizFVecMesh, 0.0);
+        vector<REAL> innerg3Gather(s.size(), 0.0);
+        vector<REAL> innerg4(sizFVecMesh, 0.0);
+        vector<REAL> innerg4Gather(s.size(), 0.0);
+        vector<REAL> innerh2(sizFVecMesh, 0.0);
+        vector<REAL> innerh2Gather(s.size(), 0.0);
+        vector<REAL> innerh4(sizFVecMesh, 0.0);
+        vector<REAL> innerh4Gather(s.size(), 0.0);
+        vector<REAL> fw(sizFVecMesh, 0.0);
+        vector<REAL> fwGather(s.size(), 0.0);
+        vector<REAL> innere4(sizFVecMesh, 0.0);
+        vector<REAL> innere4Gather(s.size(), 0.0);
+        vector<double> ind_energy(sizFVecMesh, 0.0);
         //////////
 
-        // parallel calculation of fake and real forces
-        // inner loop calculations for fake forces and one inner loop for real force : V1
-#pragma omp parallel for schedule(dynamic) private(kloop, i1)
-        for (kloop = 0; kloop < s.size(); kloop++) {
-            for (i1 = 0; i1 < ion.size(); i1++)
-                s[kloop].gradGion[i1] = (Grad(s[kloop].posvec,
-                                              ion[i1].posvec));        // push_back avoided similarly
+        // ion - ion Coulomb sums and fixed charge potential and field of the ions of this process
+        vector<ION_PAIR_SUMS> pairs(sizFVecIons);
+        vector<REAL> fqQ(sizFVecIons);
+        vector<VECTOR3D> EQ(sizFVecIons);
+
+        // w independent sums of the vertices of this process over all ions, with the ion - vertex Green's
+        // function computed on the fly: innerg3 = gEwq (and hqEq), innerg4 = gwEq, gq gives gwq
+        vector<REAL> gq(sizFVecMesh, 0.0);
+        decomposition.vertex_sums(s, ion, nanoParticle->em, innerg3, innerg4, gq);
+
+        //innerg3,innerg4 broadcasting, packed into one all gather; the ion - ion and fixed charge terms are
+        //computed while it is in flight
+        {
+            const REAL *local[2] = {&innerg3[0], &innerg4[0]};
+            REAL *full[2] = {&innerg3Gather[0], &innerg4Gather[0]};
+            mesh_exchange.start_all_gather(local, full, 2);
+            ion_fixed_terms(ion, nanoParticle, pairs, fqQ, EQ);
+            mesh_exchange.finish();
         }
 
-        // inner loop calculations for fake forces and one inner loop for real force: V2
-#pragma omp parallel for schedule(dynamic) default(shared) private(kloop, i1, gEwq, gwEq, insum)
-        for (kloop = lowerBoundMesh; kloop <= upperBoundMesh; kloop++) {
-
-            for (i1 = 0; i1 < ion.size(); i1++)
-                s[kloop].Gion[i1] = (1.0 / ((s[kloop].posvec -
-                                             ion[i1].posvec).GetMagnitude()));    // push_back avoided (with new code in main)
-
-            gEwq = 0;
-            for (i1 = 0; i1 < ion.size(); i1++)
-                gEwq += s[kloop].Gion[i1] * (ion[i1].q / ion[i1].epsilon);
-            innerg3[kloop - lowerBoundMesh] = gEwq;
-
-            gwEq = 0;
-            for (i1 = 0; i1 < ion.size(); i1++)
-                gwEq += (s[kloop].normalvec * s[kloop].gradGion[i1]) * (ion[i1].q / ion[i1].epsilon);
-            innerg4[kloop - lowerBoundMesh] = gwEq;
-
-            insum = 0;
-            for (i1 = 0; i1 < ion.size(); i1++)
-                insum = insum + (s[kloop].normalvec * s[kloop].gradGion[i1]) * (ion[i1].q / ion[i1].epsilon);
-
-            saveinsum[kloop - lowerBoundMesh] = insum;
+        // the three vectors the interface operators act on
+        vector<REAL> wa(s.size()), g3a(s.size()), g4a(s.size());
+        for (unsigned int l = 0; l < s.size(); l++) {
+            wa[l] = s[l].w * s[l].a;
+            g3a[l] = innerg3Gather[l] * s[l].a;
+            g4a[l] = innerg4Gather[l] * s[l].a;
         }
 
-        //saveinsum,innerg3,innerg4 broadcasting using all gather = gather + broadcast
-        if (world.size() > 1) {
-
-            //cout <<"This is proc : " << world.rank() << ", LowerBound"<<lowerBoundMesh<< ", UpperBound"<<upperBoundMesh<<endl;
-            //cout  << world.rank() <<" : Size of the data trying to send : " << saveinsum.size() <<"saveinsumGather size : " << saveinsumGather.size() <<endl;
-            all_gather(world, &saveinsum[0], saveinsum.size(), saveinsumGather);
-            all_gather(world, &innerg3[0], innerg3.size(), innerg3Gather);
-            all_gather(world, &innerg4[0], innerg4.size(), innerg4Gather);
-
-            //cout <<"Done proc : " << world.rank() <<endl;
-
-
-        } else {
+        if (nanoParticle->solver.direct()) {
+            // Born-Oppenheimer: the w independent sums of each row give the fake force at w = 0 (bw) and
+            // the ion field part of innerh4 (h4q); the induced charges are then solved for, and the rows of
+            // H and Kh are streamed once more for the w dependent sums of the force on the ions
+            vector<REAL> bw(sizFVecMesh, 0.0);
+            vector<REAL> bwGather(s.size(), 0.0);
+            vector<REAL> h4q(sizFVecMesh, 0.0);
+            vector<REAL> Gg4aRows(sizFVecMesh, 0.0);
+#pragma omp parallel for schedule(dynamic) default(shared) private(kloop, l1, gwq, hqEq)
             for (kloop = lowerBoundMesh; kloop <= upperBoundMesh; kloop++) {
-                saveinsumGather[kloop] = saveinsum[kloop - lowerBoundMesh];
-                innerg3Gather[kloop] = innerg3[kloop - lowerBoundMesh];
-                innerg4Gather[kloop] = innerg4[kloop - lowerBoundMesh];
+                const OPERATOR_REAL *Gk = operators.greens(kloop);
+                const OPERATOR_REAL *Hk = operators.ndotGradGreens(kloop);
+                const OPERATOR_REAL *KwEqk = operators.KwEq(kloop);
+
+                REAL Hg3a = 0, Gg4a = 0, KwEqg4a = 0;
+                for (l1 = 0; l1 < s.size(); l1++) {
+                    Hg3a += Hk[l1] * g3a[l1];
+                    Gg4a += Gk[l1] * g4a[l1];
+                    KwEqg4a += KwEqk[l1] * g4a[l1];
+                }
+
+                hqEq = innerg3[kloop - lowerBoundMesh] * (-1.0 * 0.5 * nanoParticle->ed);
+                gwq = (-1.0) * gq[kloop - lowerBoundMesh];
+
+                bw[kloop - lowerBoundMesh] = gwq + (-1.0) * 0.5 * nanoParticle->ed * Hg3a + KwEqg4a;
+                h4q[kloop - lowerBoundMesh] = hqEq + (-1.0 * nanoParticle->ed * nanoParticle->ed) * Gg4a;
+                Gg4aRows[kloop - lowerBoundMesh] = Gg4a;
             }
-        }
-
-        // continuing with inner loop calculations for force on real ions
-#pragma omp parallel for schedule(dynamic) default(shared) private(kloop, l1, hqEw, hqEq, hEqw, hEqEq, hEqEw)
-        for (kloop = lowerBoundMesh; kloop <= upperBoundMesh; kloop++) {
-            hqEw = saveinsumGather[kloop];
-            for (l1 = 0; l1 < s.size(); l1++)
-                hqEw = hqEw + s[kloop].ndotGradGreens[l1] * s[l1].w * s[l1].a;
 
-            innerh2[kloop - lowerBoundMesh] = hqEw;
-
-            hqEq = 0;
-            for (l1 = 0; l1 < ion.size(); l1++)
-                hqEq = hqEq + (s[kloop].Gion[l1] * (ion[l1].q / ion[l1].epsilon));
-            hqEq = hqEq * (-1.0 * 0.5 * nanoParticle->ed);
-
-            hEqw = 0;
-            for (l1 = 0; l1 < s.size(); l1++)
-                hEqw = hEqw + s[kloop].Greens[l1] * s[l1].w * s[l1].a;
-            hEqw = hEqw * (-1.0 * (-0.5) * nanoParticle->ed * (2 * nanoParticle->em - 1));
-
-            hEqEq = 0;
-            for (l1 = 0; l1 < s.size(); l1++)
-                hEqEq = hEqEq + s[kloop].Greens[l1] * saveinsumGather[l1] * s[l1].a;
-            hEqEq = hEqEq * (-1.0 * nanoParticle->ed * nanoParticle->ed);
-
-            hEqEw = 0;
-            for (l1 = 0; l1 < s.size(); l1++)
-                hEqEw = hEqEw + s[kloop].presumhEqEw[l1] * s[l1].w * s[l1].a;
-            hEqEw = hEqEw * (-1.0 * nanoParticle->ed * nanoParticle->ed);
-
-            innerh4[kloop - lowerBoundMesh] = (hqEq + hEqw + hEqEq + hEqEw);
-        }
-
-
-        //innerh2,innerh4 broadcasting using all gather = gather + broadcast
-        if (world.size() > 1) {
-
-            all_gather(world, &innerh2[0], innerh2.size(), innerh2Gather);
-            all_gather(world, &innerh4[0], innerh4.size(), innerh4Gather);
+            mesh_exchange.all_gather(&bw[0], &bwGather[0]);
 
+            REAL mu = nanoParticle->solver.solve(bwGather, constraint_charge(ion, nanoParticle), wa);
+            for (unsigned int k = 0; k < s.size(); k++) {
+                s[k].w = wa[k] / s[k].a;
+                s[k].vw = 0.0;
+            }
 
+#pragma omp parallel for schedule(dynamic) default(shared) private(kloop, l1)
+            for (kloop = lowerBoundMesh; kloop <= upperBoundMesh; kloop++) {
+                const OPERATOR_REAL *Hk = operators.ndotGradGreens(kloop);
+                const OPERATOR_REAL *Khk = operators.Kh(kloop);
+
+                REAL Hwa = 0, Khwa = 0;
+                for (l1 = 0; l1 < s.size(); l1++) {
+                    Hwa += Hk[l1] * wa[l1];
+                    Khwa += Khk[l1] * wa[l1];
+                }
+
+                innerh2[kloop - lowerBoundMesh] = innerg4Gather[kloop] + Hwa;
+                innerh4[kloop - lowerBoundMesh] = h4q[kloop - lowerBoundMesh] + Khwa;
+                fw[kloop - lowerBoundMesh] = mu;    // only the constraint force is left on the BO surface
+
+                // energy sums; Kww w a = mu - bw at the solution
+                innere4[kloop - lowerBoundMesh] =
+                        (-1) * Khwa + 0.5 * nanoParticle->ed * nanoParticle->ed * Gg4aRows[kloop - lowerBoundMesh];
+                ind_energy[kloop - lowerBoundMesh] = -0.5 * wa[kloop] * (mu - bw[kloop - lowerBoundMesh]);
+            }
         } else {
+            // one fused pass over the operator rows of each vertex gives both the sums for the force on the ions
+            // (innerh2 = hqEw, innerh4 = hqEq + hEqw + hEqEq + hEqEw) and the fake force
+            // (gwq + gww + gwEw + gEwEw + gEwq + gwEq + gEwEq), using the precombined Kww, KwEq and Kh
+#pragma omp parallel for schedule(dynamic) default(shared) private(kloop, l1, gwq, hqEq)
             for (kloop = lowerBoundMesh; kloop <= upperBoundMesh; kloop++) {
-
-                innerh2Gather[kloop] = innerh2[kloop - lowerBoundMesh];
-                innerh4Gather[kloop] = innerh4[kloop - lowerBoundMesh];
+                const OPERATOR_REAL *Gk = operators.greens(kloop);
+                const OPERATOR_REAL *Hk = operators.ndotGradGreens(kloop);
+                const OPERATOR_REAL *Kwwk = operators.Kww(kloop);
+                const OPERATOR_REAL *KwEqk = operators.KwEq(kloop);
+                const OPERATOR_REAL *Khk = operators.Kh(kloop);
+
+                REAL Hwa = 0, Hg3a = 0, Gg4a = 0, Khwa = 0, Kwwwa = 0, KwEqg4a = 0;
+                for (l1 = 0; l1 < s.size(); l1++) {
+                    Hwa += Hk[l1] * wa[l1];
+                    Hg3a += Hk[l1] * g3a[l1];
+                    Gg4a += Gk[l1] * g4a[l1];
+                    Khwa += Khk[l1] * wa[l1];
+                    Kwwwa += Kwwk[l1] * wa[l1];
+                    KwEqg4a += KwEqk[l1] * g4a[l1];
+                }
+
+                hqEq = innerg3[kloop - lowerBoundMesh] * (-1.0 * 0.5 * nanoParticle->ed);
+                gwq = (-1.0) * gq[kloop - lowerBoundMesh];
+
+                innerh2[kloop - lowerBoundMesh] = innerg4Gather[kloop] + Hwa;
+                innerh4[kloop - lowerBoundMesh] = hqEq + Khwa + (-1.0 * nanoParticle->ed * nanoParticle->ed) * Gg4a;
+                fw[kloop - lowerBoundMesh] = gwq + Kwwwa + (-1.0) * 0.5 * nanoParticle->ed * Hg3a + KwEqg4a;
+
+                // energy sums (inner3 and inner4 of energy_functional, and the induced-induced energy)
+                innere4[kloop - lowerBoundMesh] =
+                        (-1) * Khwa + 0.5 * nanoParticle->ed * nanoParticle->ed * Gg4a;
+                ind_energy[kloop - lowerBoundMesh] = -0.5 * wa[kloop] * Kwwwa;
             }
         }
 
-        // fake force computation
-#pragma omp parallel for schedule(dynamic) default(shared) private(kloop, l1, gEwq, gwEq_EwEq, gwq, gww_wEw_EwEw)
-        for (kloop = lowerBoundMesh; kloop <= upperBoundMesh; kloop++) {
-            gwq = 0;
-            for (l1 = 0; l1 < ion.size(); l1++)
-                gwq += (-1.0) * (0.5 - 0.5 * nanoParticle->em / ion[l1].epsilon) * ion[l1].q * s[kloop].Gion[l1];
-
-            gww_wEw_EwEw = 0;
-            for (l1 = 0; l1 < s.size(); l1++)
-                gww_wEw_EwEw += ((-1.0) * nanoParticle->em * (nanoParticle->em - 1) * s[kloop].Greens[l1] +
-                                 0.5 * nanoParticle->ed * (2 * nanoParticle->em - 1) * s[kloop].presumgwEw[l1] +
-                                 (-1.0) * nanoParticle->ed * nanoParticle->ed * s[kloop].presumgEwEw[l1]) * s[l1].w *
-                                s[l1].a;
-
-            gEwq = 0;
-            for (l1 = 0; l1 < s.size(); l1++)
-                gEwq += (-1.0) * 0.5 * nanoParticle->ed * s[kloop].ndotGradGreens[l1] * innerg3Gather[l1] * s[l1].a;
-
-            gwEq_EwEq = 0;
-            for (l1 = 0; l1 < s.size(); l1++)
-                gwEq_EwEq += (0.5 * nanoParticle->ed * (2 * nanoParticle->em - 1) * s[kloop].Greens[l1] +
-                              (-1.0) * nanoParticle->ed * nanoParticle->ed * s[kloop].presumgEwEq[l1]) *
-                             innerg4Gather[l1] *
-                             s[l1].a;
-
-            fw[kloop - lowerBoundMesh] = gwq + gww_wEw_EwEw + gEwq + gwEq_EwEq;
+        //innerh2,innerh4,fw (and innere4 for the energies) broadcasting, packed into one all gather; the
+        //short-range LJ forces are computed while it is in flight
+        {
+            const REAL *local[4] = {&innerh2[0], &innerh4[0], &fw[0], &innere4[0]};
+            REAL *full[4] = {&innerh2Gather[0], &innerh4Gather[0], &fwGather[0], &innere4Gather[0]};
+            mesh_exchange.start_all_gather(local, full, with_energy ? 4 : 3);
+            if (with_short_range)
+                lj_energy = short_range_forces(nanoParticle, lj);
+            mesh_exchange.finish();
         }
 
-        //fw broadcasting using all gather = gather + broadcast
-        if (world.size() > 1)
-            all_gather(world, &fw[0], fw.size(), fwGather);
-        else
-            for (kloop = lowerBoundMesh; kloop <= upperBoundMesh; kloop++)
-                fwGather[kloop] = fw[kloop - lowerBoundMesh];
-
         // force on the fake degrees of freedom
         for (unsigned int k = 0; k < s.size(); k++)
             s[k].fw = s[k].a * fwGather[k] * scalefactor;
 
-        // force calculation for real ions (this was in parallel with the previous for loop)
-#pragma omp parallel for schedule(dynamic) default(shared) private(iloop, l1, h0, h1, h2, h3)
-        for (iloop = lowerBoundIons; iloop <= upperBoundIons; iloop++) {
-            //h0 = ((Grad(ion[iloop].posvec, nanoParticle->posvec)) ^
-            //      ((-1.0) * nanoParticle->bare_charge * ion[iloop].q * 1.0 / ion[iloop].epsilon));
-
-            h0 = VECTOR3D(0, 0, 0);
-            for (int k = 0; k < s.size(); k++)
-                h0 = h0 + ((Grad(ion[iloop].posvec, s[k].posvec)) ^
-                           ((-1.0) * s[k].realQ * ion[iloop].q * 1.0 / ion[iloop].epsilon));
+        // vertex weights of the sums over the interface for each ion
+        ION_VERTEX_WEIGHTS weights;
+        weights.wa = wa;
+        weights.h2a.resize(s.size());
+        weights.h4a.resize(s.size());
+        weights.e4a.resize(s.size());
+        for (unsigned int k = 0; k < s.size(); k++) {
+            weights.h2a[k] = innerh2Gather[k] * s[k].a;
+            weights.h4a[k] = innerh4Gather[k] * s[k].a;
+            weights.e4a[k] = innere4Gather[k] * s[k].a;
+        }
+        vector<ION_VERTEX_SUMS> vertex_sums;
+        decomposition.ion_sums(s, ion, weights, with_energy, vertex_sums);
 
+        // force calculation for real ions
+        // h0 : central charge (realQ), h1 : ion - ion, h2 : hqw + hqEw, h3 : hqEq + hEqw + hEqEq + hEqEw
+#pragma omp parallel for schedule(dynamic) default(shared) private(iloop, h0, h1, h2, h3)
+        for (iloop = lowerBoundIons; iloop <= upperBoundIons; iloop++) {
+            const ION_VERTEX_SUMS &v = vertex_sums[iloop - lowerBoundIons];
+            const ION_PAIR_SUMS &p = pairs[iloop - lowerBoundIons];
+            double qe = ion[iloop].q / ion[iloop].epsilon;
 
-            h1 = VECTOR3D(0, 0, 0);
-            for (l1 = 0; l1 < ion.size(); l1++) {
-                if (l1 == iloop) continue;
-                h1 = h1 + ((Grad(ion[iloop].posvec, ion[l1].posvec)) ^
-                           ((-0.5) * ion[iloop].q * ion[l1].q * (1 / ion[iloop].epsilon + 1 / ion[l1].epsilon)));
-            }
+            // field of the fixed charges realQ and ion - ion Coulomb force from the pair kernel
+            h0 = EQ[iloop - lowerBoundIons] ^ qe;
+            h1 = VECTOR3D(p.coulomb[0], p.coulomb[1], p.coulomb[2]);
 
             double aqw = -1.0 * ion[iloop].q * (0.5 - nanoParticle->em / (2.0 * ion[iloop].epsilon));
             double bqEqw = -1.0 * 0.5 * nanoParticle->ed * ion[iloop].q / ion[iloop].epsilon;
-            h2 = VECTOR3D(0, 0, 0);
-            for (l1 = 0; l1 < s.size(); l1++)
-                h2 = h2 +
-                     (((s[l1].gradGion[iloop]) ^ (-1.0)) ^ ((aqw * s[l1].w + bqEqw * innerh2Gather[l1]) * s[l1].a));
+            h2 = (VECTOR3D(v.dw[0], v.dw[1], v.dw[2]) ^ (-aqw)) + (VECTOR3D(v.dh2[0], v.dh2[1], v.dh2[2]) ^ (-bqEqw));
 
-
-            h3 = VECTOR3D(0, 0, 0);
-            for (l1 = 0; l1 < s.size(); l1++)
-                h3 = h3 +
-                     (GradndotGrad(s[l1].posvec, ion[iloop].posvec, s[l1].normalvec) ^ (innerh4Gather[l1] * s[l1].a));
-            h3 = (h3 ^ (ion[iloop].q / ion[iloop].epsilon));
+            h3 = VECTOR3D(v.h4[0], v.h4[1], v.h4[2]) ^ qe;
 
             forvec[iloop - lowerBoundIons] = (h0 + h1 + h2 + h3);
 
+            // electrostatic energy of the ion (fqq + fwq + fqEq_qEw + fwEq_EqEq_EwEq + central charge) from the
+            // same sums; innerh2 is saveinner1 + inner2 of energy_functional
+            if (with_energy)
+                ion_energy[iloop - lowerBoundIons] = p.coulomb_energy +
+                                                     ion[iloop].q * (0.5 - 0.5 * nanoParticle->em / ion[iloop].epsilon) * v.Gw +
+                                                     0.5 * nanoParticle->ed * qe * v.Gh2 + qe * v.ne4 +
+                                                     qe * fqQ[iloop - lowerBoundIons];
         }
 
-        saveinsum.clear();
-        saveinsumGather.clear();
+        for (unsigned int k = 0; k < ind_energy.size(); k++)
+            ind_ind = ind_ind + ind_energy[k];
+
         innerg3.clear();
         innerg3Gather.clear();
         innerg4.clear();
@@ -267,26 +289,28 @@ for_cpmd_calculate_force(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle
         VECTOR3D h0, h1, h2, h3;
         // parallel calculation of real forces (uniform case)
 
-#pragma omp parallel for schedule(dynamic) default(shared) private(iloop, j1, h0, h1)
+#pragma omp parallel for schedule(dynamic) default(shared) private(iloop, h0, h1)
         for (iloop = lowerBoundIons; iloop <= upperBoundIons; iloop++) {
             //h0 = ((Grad(ion[iloop].posvec, nanoParticle->posvec)) ^
              //     ((-1.0) * nanoParticle->bare_charge * ion[iloop].q * 1.0 / ion[iloop].epsilon));
 
-            h0 = VECTOR3D(0, 0, 0);
-            for (int k = 0; k < s.size(); k++)
-            h0 = h0 + ((Grad(ion[iloop].posvec, s[k].posvec)) ^
-                  ((-1.0) * s[k].realQ * ion[iloop].q * 1.0 / ion[iloop].epsilon));
+            // field of the fixed charges realQ (tabulated away from the interface)
+            REAL fqQ;
+            VECTOR3D EQ;
+            nanoParticle->surface_field.evaluate(ion[iloop].posvec, fqQ, EQ);
+            h0 = EQ ^ (ion[iloop].q / ion[iloop].epsilon);
 
             //if (iloop == 0)
             //cout << iloop << " : " << h0.GetMagnitude() << endl;
 
-            h1 = VECTOR3D(0, 0, 0);
-            for (j1 = 0; j1 < ion.size(); j1++) {
-                if (j1 == iloop) continue;
-                h1 = h1 + ((Grad(ion[iloop].posvec, ion[j1].posvec)) ^
-                           ((-0.5) * ion[iloop].q * ion[j1].q * (1 / ion[iloop].epsilon + 1 / ion[j1].epsilon)));
-            }
+            // ion - ion Coulomb force from the pair kernel
+            ION_PAIR_SUMS pairs;
+            ion_pair_sums(ion_arrays, iloop, pairs);
+            h1 = VECTOR3D(pairs.coulomb[0], pairs.coulomb[1], pairs.coulomb[2]);
             forvec[iloop - lowerBoundIons] = (h0 + h1);
+
+            if (with_energy)
+                ion_energy[iloop - lowerBoundIons] = pairs.coulomb_energy + ion[iloop].q / ion[iloop].epsilon * fqQ;
         }
 
 
@@ -294,136 +318,65 @@ for_cpmd_calculate_force(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle
         for (unsigned int k = 0; k < s.size(); k++)
             s[k].fw = 0.0;
 
+        if (with_short_range)
+            lj_energy = short_range_forces(nanoParticle, lj);
     }
 
     /////////////////////// Not POLARIZED over
 
-    // Excluded volume interactions given by purely repulsive LJ
-
-    // ion-sphere (when ion is outside)
-    // make a dummy particle with the same diameter as the ion just beneath the interface
-
-    for (iloop = lowerBoundIons; iloop <= upperBoundIons; iloop++) {
-        VECTOR3D fljcs = VECTOR3D(0, 0, 0);
-        if (ion[iloop].posvec.GetMagnitude() < nanoParticle->radius)
-            continue;
-
-        PARTICLE dummy = PARTICLE(0, ion[iloop].diameter, 0, 0, 0, nanoParticle->ein,
-                                  ion[iloop].posvec ^ ((nanoParticle->radius -
-                                                        0.5 *
-                                                        ion[iloop].diameter) /
-                                                       ion[iloop].posvec.GetMagnitude()));
-        VECTOR3D r_vec = ion[iloop].posvec - dummy.posvec;
-        double r = r_vec.GetMagnitude();
-        double d = 0.5 * (ion[iloop].diameter + dummy.diameter);
-        double elj = 1.0;
-        if (r < dcut * d) {
-            double r2 = r * r;
-            double r6 = r2 * r2 * r2;
-            double r12 = r6 * r6;
-            double d2 = d * d;
-            double d6 = d2 * d2 * d2;
-            double d12 = d6 * d6;
-            fljcs = r_vec ^ (48 * elj * ((d12 / r12) - 0.5 * (d6 / r6)) * (1 / r2));
-            lj1[iloop - lowerBoundIons] = fljcs;
-        }
+    // Excluded volume interactions given by purely repulsive LJ (ion-ion pairs from the neighbor list,
+    // ion-sphere and ion-box, in one parallel short-range pass) are in lj
 
-    }
+    // Total force on the particle = the electrostatic force + the Lennard-Jones force
+    for (iloop = 0; iloop < forvec.size(); iloop++)
+        forvec[iloop] = ((forvec[iloop]) ^ (scalefactor)) + lj[iloop];
 
-    // ion-ion
-#pragma omp parallel for schedule(dynamic) default(shared) private(iloop, j1)
-    for (iloop = lowerBoundIons; iloop <= upperBoundIons; iloop++) {
-        VECTOR3D fljcc = VECTOR3D(0, 0, 0);
-        for (j1 = 0; j1 < ion.size(); j1++) {
-            if (j1 == iloop) continue;
-            VECTOR3D r_vec = ion[iloop].posvec - ion[j1].posvec;
-            double r = r_vec.GetMagnitude();
-            double d = 0.5 * (ion[iloop].diameter + ion[j1].diameter);
-            double elj = 1.0;
-            if (r < dcut * d) {
-                double r2 = r * r;
-                double r6 = r2 * r2 * r2;
-                double r12 = r6 * r6;
-                double d2 = d * d;
-                double d6 = d2 * d2 * d2;
-                double d12 = d6 * d6;
-                fljcc = fljcc + (r_vec ^ (48 * elj * ((d12 / r12) - 0.5 * (d6 / r6)) * (1 / r2)));
-            }
-        }
-        lj2[iloop - lowerBoundIons] = fljcc;
-    }
+    //forvec broadcasting using all gather = gather + broadcast, as 3 values per ion
+    static_assert(sizeof(VECTOR3D) == 3 * sizeof(REAL), "VECTOR3D is exchanged as its 3 components");
+    ion_exchange.all_gather(&forvec[0].x, &forvecGather[0].x, 3);
 
-    // ion-box
-    // make a dummy particle with the same diameter as the ion just above the simulation box
-    for (iloop = lowerBoundIons; iloop <= upperBoundIons; iloop++) {
-        PARTICLE dummy = PARTICLE(0, ion[iloop].diameter, 0, 0, 0, nanoParticle->eout, ion[iloop].posvec ^
-                                                                                      ((nanoParticle->box_radius +
-                                                                                        0.5 * ion[iloop].diameter) /
-                                                                                       ion[iloop].posvec.GetMagnitude()));
-        VECTOR3D r_vec = ion[iloop].posvec - dummy.posvec;
-        double r = r_vec.GetMagnitude();
-        double d = 0.5 * (ion[iloop].diameter + dummy.diameter);
-        double elj = 1.0;
-        if (r < dcut * d) {
-            double r2 = r * r;
-            double r6 = r2 * r2 * r2;
-            double r12 = r6 * r6;
-            double d2 = d * d;
-            double d6 = d2 * d2 * d2;
-            double d12 = d6 * d6;
-            lj3[iloop - lowerBoundIons] = r_vec ^ (48 * elj * ((d12 / r12) - 0.5 * (d6 / r6)) * (1 / r2));
-        }
+    // force on the particles (electrostatic)
+    for (iloop = 0; iloop < ion.size(); iloop++)
+        ion[iloop].forvec = forvecGather[iloop];
 
-    }
+    forvec.clear();
+    forvecGather.clear();
+    lj.clear();
 
-    // ion-sphere (works when ions are inside)
-    // make a dummy particle with the same diameter as the ion just above the interface
-    for (iloop = lowerBoundIons; iloop <= upperBoundIons; iloop++) {
-
-        if (ion[iloop].posvec.GetMagnitude() > nanoParticle->radius)
-            continue;
-
-        PARTICLE dummy = PARTICLE(0, ion[iloop].diameter, 0, 0, 0, nanoParticle->eout, ion[iloop].posvec ^
-                                                                                      ((nanoParticle->radius +
-                                                                                        0.5 * ion[iloop].diameter) /
-                                                                                       ion[iloop].posvec.GetMagnitude()));
-        VECTOR3D r_vec = ion[iloop].posvec - dummy.posvec;
-        double r = r_vec.GetMagnitude();
-        double d = 0.5 * (ion[iloop].diameter + dummy.diameter);
-        double elj = 1.0;
-        if (r < dcut * d) {
-            double r2 = r * r;
-            double r6 = r2 * r2 * r2;
-            double r12 = r6 * r6;
-            double d2 = d * d;
-            double d6 = d2 * d2 * d2;
-            double d12 = d6 * d6;
-            lj4[iloop - lowerBoundIons] = r_vec ^ (48 * elj * ((d12 / r12) - 0.5 * (d6 / r6)) * (1 / r2));
-        }
+    if (!with_energy)
+        return 0;
 
-    }
+    //  Assess the electrostatic component of the PE for each ion (for use in Diehl's Method):
+    for (unsigned int i = 0; i < ion_energy.size(); i++)
+        ion[i].electrostaticPE = scalefactor * ion_energy[i];
 
-    // Total force on the particle = the electrostatic force + the Lennard-Jones force
-    for (iloop = 0; iloop < forvec.size(); iloop++)
-        forvec[iloop] = ((forvec[iloop]) ^ (scalefactor)) + lj1[iloop] + lj2[iloop] + lj3[iloop] + lj4[iloop];
+    double ion_ion = 0;
+    for (unsigned int i = 0; i < ion_energy.size(); i++)
+        ion_ion = ion_ion + ion_energy[i];
 
-    //forvec broadcasting using all gather = gather + broadcast
+    double potential = (ion_ion + ind_ind) * scalefactor + lj_energy, totalPotential;
     if (world.size() > 1)
-        all_gather(world, &forvec[0], forvec.size(), forvecGather);
+        all_reduce(world, potential, totalPotential, std::plus<double>());
     else
-        for (iloop = lowerBoundIons; iloop <= upperBoundIons; iloop++)
-            forvecGather[iloop] = forvec[iloop - lowerBoundIons];
+        totalPotential = potential;
+    return totalPotential;
+}
 
-    // force on the particles (electrostatic)
-    for (iloop = 0; iloop < ion.size(); iloop++)
-        ion[iloop].forvec = forvecGather[iloop];
+// LJ forces on all ions, gathered into lj, for the inner steps of r-RESPA; with_energy also returns the LJ energy
+double for_cpmd_short_range_force(vector<PARTICLE> &ion, NanoParticle *nanoParticle, vector<VECTOR3D> &lj,
+                                  bool with_energy) {
 
-    forvec.clear();
-    forvecGather.clear();
-    lj1.clear();
-    lj2.clear();
-    lj3.clear();
-    lj4.clear();
+    vector<VECTOR3D> local(sizFVecIons, VECTOR3D(0, 0, 0));
+    double lj_energy = short_range_forces(nanoParticle, local);
+    lj.resize(ion.size());
+    ion_exchange.all_gather(&local[0].x, &lj[0].x, 3);
 
-    return;
+    if (!with_energy)
+        return 0;
+    double total_lj_energy;
+    if (world.size() > 1)
+        all_reduce(world, lj_energy, total_lj_energy, std::plus<double>());
+    else
+        total_lj_energy = lj_energy;
+    return total_lj_energy;
 }
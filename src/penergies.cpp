@@ -20,27 +20,21 @@ double energy_functional(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle
 
     //Common MPI Message objects
     vector<double> ion_energy(sizFVecIons, 0.0);
-    vector<double> lj1(sizFVecIons, 0.0);
-    vector<double> lj2(sizFVecIons, 0.0);
-    vector<double> lj3(sizFVecIons, 0.0);
-    vector<double> lj4(sizFVecIons, 0.0);
 
     double potential,totalPotential;
-    unsigned int i, j;
+    unsigned int i;
 
     if (nanoParticle->POLARIZED) {
 
         /////////////POLARIZED only MPI Message objects
-        vector<long double> saveinner1(sizFVecMesh, 0.0);
-        vector<long double> saveinner1Gather(s.size() + extraElementsMesh, 0.0);
-        vector<long double> inner2(sizFVecMesh, 0.0);
-        vector<long double> inner2Gather(s.size() + extraElementsMesh, 0.0);
-        vector<long double> inner3(sizFVecMesh, 0.0);
-        vector<long double> inner3Gather(s.size() + extraElementsMesh, 0.0);
-        vector<long double> inner4(sizFVecMesh, 0.0);
-        vector<long double> inner4Gather(s.size() + extraElementsMesh, 0.0);
-        vector<long double> inner5(sizFVecMesh, 0.0);
-        vector<long double> inner5Gather(s.size() + extraElementsMesh, 0.0);
+        vector<REAL> saveinner1(sizFVecMesh, 0.0);
+        vector<REAL> saveinner1Gather(s.size(), 0.0);
+        vector<REAL> inner2(sizFVecMesh, 0.0);
+        vector<REAL> inner2Gather(s.size(), 0.0);
+        vector<REAL> inner3(sizFVecMesh, 0.0);
+        vector<REAL> inner3Gather(s.size(), 0.0);
+        vector<REAL> inner4(sizFVecMesh, 0.0);
+        vector<REAL> inner4Gather(s.size(), 0.0);
         vector<double> ind_energy(sizFVecMesh, 0.0);
 
 
@@ -61,71 +55,51 @@ double energy_functional(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle
         }
 
         //saveinner1 broadcasting using all gather = gather + broadcast
-        if (world.size() > 1)
-            all_gather(world, &saveinner1[0], saveinner1.size(), saveinner1Gather);
-        else
-            for (k = lowerBoundMesh; k <= upperBoundMesh; k++)
-                saveinner1Gather[k] = saveinner1[k - lowerBoundMesh];
+        mesh_exchange.all_gather(&saveinner1[0], &saveinner1Gather[0]);
 
 
-#pragma omp parallel for schedule(dynamic) default(shared) private(k, l, insum)
-        for (k = lowerBoundMesh; k <= upperBoundMesh; k++) {
-            insum = 0;
-            for (l = 0; l < s.size(); l++)
-                insum += s[k].ndotGradGreens[l] * s[l].w * s[l].a;
-            inner2[k - lowerBoundMesh] = insum;
-
-            insum = 0;
-            for (l = 0; l < s.size(); l++)
-                insum += s[k].Greens[l] * s[l].w * s[l].a;
-            inner3[k - lowerBoundMesh] = insum;
-
-            insum = 0;
-            for (l = 0; l < s.size(); l++)
-                insum += s[k].Greens[l] * saveinner1Gather[l] * s[l].a;
-            inner4[k - lowerBoundMesh] = insum;
-
-            insum = 0;
-            for (l = 0; l < s.size(); l++)
-                insum += s[k].presumfEwEq[l] * s[l].w * s[l].a;
-            inner5[k - lowerBoundMesh] = insum;
-        }
-        //inner2,inner3,inner4 broadcasting using all gather = gather + broadcast
-        if (world.size() > 1) {
-
-            all_gather(world, &inner2[0], inner2.size(), inner2Gather);
-            all_gather(world, &inner3[0], inner3.size(), inner3Gather);
-            all_gather(world, &inner4[0], inner4.size(), inner4Gather);
-            all_gather(world, &inner5[0], inner5.size(), inner5Gather);
-
-        } else {
-            for (k = lowerBoundMesh; k <= upperBoundMesh; k++) {
-                inner2Gather[k] = inner2[k - lowerBoundMesh];
-                inner3Gather[k] = inner3[k - lowerBoundMesh];
-                inner4Gather[k] = inner4[k - lowerBoundMesh];
-                inner5Gather[k] = inner5[k - lowerBoundMesh];
-            }
+        vector<REAL> wa(s.size()), s1a(s.size());
+        for (l = 0; l < s.size(); l++) {
+            wa[l] = s[l].w * s[l].a;
+            s1a[l] = saveinner1Gather[l] * s[l].a;
         }
 
-#pragma omp parallel for schedule(dynamic) default(shared) private(k, l, ind_ind)
+        // one pass over the rows of H, G and the precombined Kh and Kww:
+        // inner2 = H w a, inner3 = Kh w a (fwEq + fEwEq parts), inner4 = G saveinner1 a,
+        // and the induced-induced energy w a Kww w a / (-2), since the symmetric part of its old kernel
+        // (0.5 em(em-1) G - 0.5 ed(2em-1) P + 0.5 ed^2 Q) is -Kww / 2
+#pragma omp parallel for schedule(dynamic) default(shared) private(k, l)
         for (k = lowerBoundMesh; k <= upperBoundMesh; k++) {
-            ind_ind = 0;
-            for (l = 0; l < s.size(); l++)
-                ind_ind += s[k].w * s[k].a *
-                           ((-0.5) * nanoParticle->ed * (2 * nanoParticle->em - 1) * s[k].presumfwEw[l] +
-                            0.5 * nanoParticle->em * (nanoParticle->em - 1) * s[k].Greens[l] +
-                            0.5 * nanoParticle->ed * nanoParticle->ed * s[k].presumgEwEw[l]) * s[l].w * s[l].a;
-            ind_energy[k - lowerBoundMesh] = ind_ind;
+            const OPERATOR_REAL *Gk = nanoParticle->operators.greens(k);
+            const OPERATOR_REAL *Hk = nanoParticle->operators.ndotGradGreens(k);
+            const OPERATOR_REAL *Khk = nanoParticle->operators.Kh(k);
+            const OPERATOR_REAL *Kwwk = nanoParticle->operators.Kww(k);
+
+            REAL Hwa = 0, Khwa = 0, Gs1a = 0, Kwwwa = 0;
+            for (l = 0; l < s.size(); l++) {
+                Hwa += Hk[l] * wa[l];
+                Khwa += Khk[l] * wa[l];
+                Gs1a += Gk[l] * s1a[l];
+                Kwwwa += Kwwk[l] * wa[l];
+            }
+            inner2[k - lowerBoundMesh] = Hwa;
+            inner3[k - lowerBoundMesh] = Khwa;
+            inner4[k - lowerBoundMesh] = Gs1a;
+            ind_energy[k - lowerBoundMesh] = -0.5 * wa[k] * Kwwwa;
+        }
+        //inner2,inner3,inner4 broadcasting, packed into one all gather
+        {
+            const REAL *local[3] = {&inner2[0], &inner3[0], &inner4[0]};
+            REAL *full[3] = {&inner2Gather[0], &inner3Gather[0], &inner4Gather[0]};
+            mesh_exchange.all_gather(local, full, 3);
         }
 
 #pragma omp parallel for schedule(dynamic) default(shared) private(k, i, insum, fqq, fwq, fqEq_qEw, fwEq_EqEq_EwEq)
         for (i = lowerBoundIons; i <= upperBoundIons; i++) {
-            fqq = 0;
-            for (k = 0; k < ion.size(); k++) {
-                if (i == k) continue;
-                fqq += 0.5 * ion[i].q * ion[k].q * (1.0 / ion[i].epsilon) /
-                       ((ion[i].posvec - ion[k].posvec).GetMagnitude());
-            }
+            // ion - ion Coulomb energy from the pair kernel
+            ION_PAIR_SUMS pairs;
+            ion_pair_sums(ion_arrays, i, pairs);
+            fqq = pairs.coulomb_energy;
 
             fwq = 0;
             for (k = 0; k < s.size(); k++)
@@ -141,15 +115,14 @@ double energy_functional(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle
             insum = 0;
             for (k = 0; k < s.size(); k++)
                 insum += (s[k].normalvec * Grad(s[k].posvec, ion[i].posvec)) *
-                         ((-1) * 0.5 * nanoParticle->ed * (2 * nanoParticle->em - 1) * inner3Gather[k] +
-                          0.5 * nanoParticle->ed * nanoParticle->ed * inner4Gather[k] +
-                          nanoParticle->ed * nanoParticle->ed * inner5Gather[k]) * s[k].a;
+                         ((-1) * inner3Gather[k] + 0.5 * nanoParticle->ed * nanoParticle->ed * inner4Gather[k]) * s[k].a;
             fwEq_EqEq_EwEq = (ion[i].q / ion[i].epsilon) * insum;
 
-            insum = 0;
-            for (k = 0; k < s.size(); k++)
-                insum += s[k].realQ * ion[i].q * (1.0 / ion[i].epsilon) /
-                ((ion[i].posvec - s[k].posvec).GetMagnitude());
+            // potential of the fixed charges realQ (tabulated away from the interface)
+            REAL fqQ;
+            VECTOR3D EQ;
+            nanoParticle->surface_field.evaluate(ion[i].posvec, fqQ, EQ);
+            insum = ion[i].q * (1.0 / ion[i].epsilon) * fqQ;
             /*
             ion_energy[i-lowerBoundIons] = fqq + fwq + fqEq_qEw + fwEq_EqEq_EwEq +
                             nanoParticle->bare_charge * ion[i].q * (1.0 / ion[i].epsilon) /
@@ -177,19 +150,18 @@ double energy_functional(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle
     {
         double fqq;
 
-#pragma omp parallel for schedule(dynamic) default(shared) private(i, j, fqq)
+#pragma omp parallel for schedule(dynamic) default(shared) private(i, fqq)
             for (i = lowerBoundIons; i <= upperBoundIons; i++) {
-                fqq = 0;
-                for (j = 0; j < ion.size(); j++) {
-                    if (i == j) continue;
-                    fqq += 0.5 * ion[i].q * ion[j].q * (1.0 / ion[i].epsilon) /
-                           ((ion[i].posvec - ion[j].posvec).GetMagnitude());
-                }
-
-                double insum = 0;
-                for (int k = 0; k < s.size(); k++)
-                    insum += s[k].realQ * ion[i].q * (1.0 / ion[i].epsilon) /
-                             ((ion[i].posvec - s[k].posvec).GetMagnitude());
+                // ion - ion Coulomb energy from the pair kernel
+                ION_PAIR_SUMS pairs;
+                ion_pair_sums(ion_arrays, i, pairs);
+                fqq = pairs.coulomb_energy;
+
+                // potential of the fixed charges realQ (tabulated away from the interface)
+                REAL fqQ;
+                VECTOR3D EQ;
+                nanoParticle->surface_field.evaluate(ion[i].posvec, fqQ, EQ);
+                double insum = ion[i].q * (1.0 / ion[i].epsilon) * fqQ;
 
                 //ion_energy[i-lowerBoundIons] = fqq + nanoParticle->bare_charge * ion[i].q * (1.0 / ion[i].epsilon) /
                 //                      ((ion[i].posvec - nanoParticle->posvec).GetMagnitude());
@@ -209,111 +181,9 @@ double energy_functional(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParticle
         potential = (ion_ion) * scalefactor;
     }
 
-    // Excluded volume interaction energy given by purely repulsive LJ
-
-    // ion-sphere (ions outsdie)
-    // make a dummy particle with the same diameter as the ion just beneath the interface
-
-    for (i = lowerBoundIons; i <= upperBoundIons; i++) {
-        if (ion[i].posvec.GetMagnitude() < nanoParticle->radius)
-            continue;
-
-        PARTICLE dummy = PARTICLE(0, ion[i].diameter, 0, 0, 0, nanoParticle->ein, ion[i].posvec ^ ((nanoParticle->radius -
-                                                                                                   0.5 *
-                                                                                                   ion[i].diameter) /
-                                                                                                  ion[i].posvec.GetMagnitude()));
-        VECTOR3D r_vec = ion[i].posvec - dummy.posvec;
-        double r = r_vec.GetMagnitude();
-        double d = 0.5 * (ion[i].diameter + dummy.diameter);
-        double elj = 1.0;
-        if (r < dcut * d) {
-            double r2 = r * r;
-            double r6 = r2 * r2 * r2;
-            double d2 = d * d;
-            double d6 = d2 * d2 * d2;
-            lj1[i-lowerBoundIons] = 4 * elj * (d6 / r6) * ((d6 / r6) - 1) + elj;
-        }
-    }
-
-    // ion-ion
-#pragma omp parallel for schedule(dynamic) default(shared) private(i, j)
-    for (i = lowerBoundIons; i <= upperBoundIons; i++) {
-        double uljcc = 0.0;
-        for (j = 0; j < ion.size(); j++) {
-            if (j == i) continue;
-            VECTOR3D r_vec = ion[i].posvec - ion[j].posvec;
-            double r = r_vec.GetMagnitude();
-            double d = 0.5 * (ion[i].diameter + ion[j].diameter);
-            double elj = 1.0;
-            if (r < dcut * d) {
-                double r2 = r * r;
-                double r6 = r2 * r2 * r2;
-                double d2 = d * d;
-                double d6 = d2 * d2 * d2;
-                uljcc = uljcc + 4 * elj * (d6 / r6) * ((d6 / r6) - 1) + elj;
-            }
-        }
-        lj2[i-lowerBoundIons]=uljcc;
-    }
-
-    // ion-box
-    // make a dummy particle with the same diameter as the ion just above the simulation box
-
-    for (i = lowerBoundIons; i <= upperBoundIons; i++) {
-        PARTICLE dummy = PARTICLE(0, ion[i].diameter, 0, 0, 0, nanoParticle->eout, ion[i].posvec ^
-                                                                                  ((nanoParticle->box_radius +
-                                                                                    0.5 * ion[i].diameter) /
-                                                                                   ion[i].posvec.GetMagnitude()));
-        VECTOR3D r_vec = ion[i].posvec - dummy.posvec;
-        double r = r_vec.GetMagnitude();
-        double d = 0.5 * (ion[i].diameter + dummy.diameter);
-        double elj = 1.0;
-        if (r < dcut * d) {
-            double r2 = r * r;
-            double r6 = r2 * r2 * r2;
-            double d2 = d * d;
-            double d6 = d2 * d2 * d2;
-            lj3[i-lowerBoundIons] = 4 * elj * (d6 / r6) * ((d6 / r6) - 1) + elj;
-        }
-
-    }
-
-    // ion-sphere (ions inside)
-    // make a dummy particle with the same diameter as the ion just above the interface
-
-    for (i = lowerBoundIons; i <= upperBoundIons; i++) {
-        if (ion[i].posvec.GetMagnitude() > nanoParticle->radius)
-            continue;
-
-        PARTICLE dummy = PARTICLE(0, ion[i].diameter, 0, 0, 0, nanoParticle->eout, ion[i].posvec ^
-                                                                                  ((nanoParticle->radius +
-                                                                                    0.5 * ion[i].diameter) /
-                                                                                   ion[i].posvec.GetMagnitude()));
-        VECTOR3D r_vec = ion[i].posvec - dummy.posvec;
-        double r = r_vec.GetMagnitude();
-        double d = 0.5 * (ion[i].diameter + dummy.diameter);
-        double elj = 1.0;
-        if (r < dcut * d) {
-            double r2 = r * r;
-            double r6 = r2 * r2 * r2;
-            double d2 = d * d;
-            double d6 = d2 * d2 * d2;
-            lj4[i-lowerBoundIons] = 4 * elj * (d6 / r6) * ((d6 / r6) - 1) + elj;
-        }
-    }
-
-    double lj1energy = 0,lj2energy = 0,lj3energy = 0,lj4energy = 0;
-
-    for (unsigned int i = 0; i < lj1.size(); i++) {
-        lj1energy += lj1[i];
-        lj2energy += lj2[i];
-        lj3energy += lj3[i];
-        lj4energy += lj4[i];
-    }
-
-    lj2energy = 0.5 * lj2energy;
-
-    potential = potential + lj1energy + lj2energy + lj3energy + lj4energy;
+    // Excluded volume interaction energy given by purely repulsive LJ: ion-ion pairs from the neighbor list
+    // (each pair counted half on both ions), ion-sphere (ions outside and inside) and ion-box, in one parallel pass
+    potential = potential + short_range_energy(nanoParticle);
 
     //MPI Operations
     if (world.size() > 1) {
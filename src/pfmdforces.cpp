@@ -19,90 +19,59 @@ void for_fmd_calculate_force(vector<VERTEX> &s, vector<PARTICLE> &ion, NanoParti
     if (nanoParticle->POLARIZED) {
 
         // declarations (necessary beforehand for parallel implementation)
-        long double gwq, gww_wEw_EwEw, gEwq, gwEq, gwEq_EwEq;
-        unsigned int kloop, l1, i1;
+        REAL gwq;
+        unsigned int kloop, l1;
 
         
         
         /////////////POLARIZED only MPI Message objects
-        vector<long double> innerg3(sizFVecMesh, 0.0);
-        vector<long double> innerg3Gather(s.size() + extraElementsMesh, 0.0);
-        vector<long double> innerg4(sizFVecMesh, 0.0);
-        vector<long double> innerg4Gather(s.size() + extraElementsMesh, 0.0);
-        vector<long double> fw(sizFVecMesh, 0.0);
-        vector<long double> fwGather(s.size() + extraElementsMesh, 0.0);
-
-        // some pre-summations (Green's function, gradient of Green's function, gEwq, gwEq)
-
-#pragma parallel omp for schedule(dynamic) default(shared) private(kloop, i1, gEwq, gwEq)
-            for (kloop = lowerBoundMesh; kloop <= upperBoundMesh; kloop++) {
-                for (i1 = 0; i1 < ion.size(); i1++) {
-                    s[kloop].Gion[i1] = (1.0 / ((s[kloop].posvec -
-                                                 ion[i1].posvec).GetMagnitude()));    // push_back avoided (with new code in main)
-                    s[kloop].gradGion[i1] = (Grad(s[kloop].posvec,
-                                                  ion[i1].posvec));        // push_back avoided similarly
-                }
-
-                gEwq = 0;
-                for (i1 = 0; i1 < ion.size(); i1++)
-                    gEwq += s[kloop].Gion[i1] * (ion[i1].q / ion[i1].epsilon);
-                innerg3[kloop - lowerBoundMesh] = gEwq;
-
-                gwEq = 0;
-                for (i1 = 0; i1 < ion.size(); i1++)
-                    gwEq += (s[kloop].normalvec * s[kloop].gradGion[i1]) * (ion[i1].q / ion[i1].epsilon);
-                innerg4[kloop - lowerBoundMesh] = gwEq;
-            }
-
-
-        //innerg3,innerg4 broadcasting using all gather = gather + broadcast
-        if (world.size() > 1) {
-
-            all_gather(world, &innerg3[0], innerg3.size(), innerg3Gather);
-            all_gather(world, &innerg4[0], innerg4.size(), innerg4Gather);
-
-        } else {
-            for (kloop = lowerBoundMesh; kloop <= upperBoundMesh; kloop++) {
-
-                innerg3Gather[kloop] = innerg3[kloop - lowerBoundMesh];
-                innerg4Gather[kloop] = innerg4[kloop - lowerBoundMesh];
+        vector<REAL> innerg3(sizFVecMesh, 0.0);
+        vector<REAL> innerg3Gather(s.size(), 0.0);
+        vector<REAL> innerg4(sizFVecMesh, 0.0);
+        vector<REAL> innerg4Gather(s.size(), 0.0);
+        vector<REAL> fw(sizFVecMesh, 0.0);
+        vector<REAL> fwGather(s.size(), 0.0);
+
+        // some pre-summations (gEwq, gwEq and the ion part of gwq) over all ions, with the ion - vertex
+        // Green's function and its gradient computed on the fly
+        vector<REAL> gq(sizFVecMesh, 0.0);
+        decomposition.vertex_sums(s, ion, nanoParticle->em, innerg3, innerg4, gq);
+
+        //innerg3,innerg4 broadcasting, packed into one all gather
+        {
+            const REAL *local[2] = {&innerg3[0], &innerg4[0]};
+            REAL *full[2] = {&innerg3Gather[0], &innerg4Gather[0]};
+            mesh_exchange.all_gather(local, full, 2);
+        }
 
-            }
+        // the vectors the interface operators act on
+        vector<REAL> wa(s.size()), g3a(s.size()), g4a(s.size());
+        for (unsigned int l = 0; l < s.size(); l++) {
+            wa[l] = s[l].w * s[l].a;
+            g3a[l] = innerg3Gather[l] * s[l].a;
+            g4a[l] = innerg4Gather[l] * s[l].a;
         }
 
-            // calculate force
-#pragma parallel omp for schedule(dynamic) default(shared) private(kloop, l1, gEwq, gwq, gwEq_EwEq, gww_wEw_EwEw)
-            for (kloop = lowerBoundMesh; kloop <= upperBoundMesh; kloop++) {
-                gwq = 0;
-                for (l1 = 0; l1 < ion.size(); l1++)
-                    gwq += (-1.0) * (0.5 - 0.5 * nanoParticle->em / ion[l1].epsilon) * ion[l1].q * s[kloop].Gion[l1];
-
-                gww_wEw_EwEw = 0;
-                for (l1 = 0; l1 < s.size(); l1++)
-                    gww_wEw_EwEw += ((-1.0) * nanoParticle->em * (nanoParticle->em - 1) * s[kloop].Greens[l1] +
-                                     0.5 * nanoParticle->ed * (2 * nanoParticle->em - 1) * s[kloop].presumgwEw[l1] +
-                                     (-1.0) * nanoParticle->ed * nanoParticle->ed * s[kloop].presumgEwEw[l1]) * s[l1].w *
-                                    s[l1].a;
-
-                gEwq = 0;
-                for (l1 = 0; l1 < s.size(); l1++)
-                    gEwq += (-1.0) * 0.5 * nanoParticle->ed * s[kloop].ndotGradGreens[l1] * innerg3Gather[l1] * s[l1].a;
-
-                gwEq_EwEq = 0;
-                for (l1 = 0; l1 < s.size(); l1++)
-                    gwEq_EwEq += (0.5 * nanoParticle->ed * (2 * nanoParticle->em - 1) * s[kloop].Greens[l1] +
-                                  (-1.0) * nanoParticle->ed * nanoParticle->ed * s[kloop].presumgEwEq[l1]) * innerg4Gather[l1] *
-                                 s[l1].a;
-
-                fw[kloop - lowerBoundMesh] = gwq + gww_wEw_EwEw + gEwq + gwEq_EwEq;
+        // calculate force: one fused pass over the rows of H and the precombined Kww and KwEq
+#pragma omp parallel for schedule(dynamic) default(shared) private(kloop, l1, gwq)
+        for (kloop = lowerBoundMesh; kloop <= upperBoundMesh; kloop++) {
+            const OPERATOR_REAL *Hk = nanoParticle->operators.ndotGradGreens(kloop);
+            const OPERATOR_REAL *Kwwk = nanoParticle->operators.Kww(kloop);
+            const OPERATOR_REAL *KwEqk = nanoParticle->operators.KwEq(kloop);
+            gwq = (-1.0) * gq[kloop - lowerBoundMesh];
+
+            REAL Kwwwa = 0, Hg3a = 0, KwEqg4a = 0;
+            for (l1 = 0; l1 < s.size(); l1++) {
+                Kwwwa += Kwwk[l1] * wa[l1];
+                Hg3a += Hk[l1] * g3a[l1];
+                KwEqg4a += KwEqk[l1] * g4a[l1];
             }
 
+            fw[kloop - lowerBoundMesh] = gwq + Kwwwa + (-1.0) * 0.5 * nanoParticle->ed * Hg3a + KwEqg4a;
+        }
+
         //fw broadcasting using all gather = gather + broadcast
-        if (world.size() > 1)
-            all_gather(world, &fw[0], fw.size(), fwGather);
-        else
-            for (kloop = lowerBoundMesh; kloop <= upperBoundMesh; kloop++)
-                fwGather[kloop] = fw[kloop - lowerBoundMesh];
+        mesh_exchange.all_gather(&fw[0], &fwGather[0]);
 
         // force on the fake degrees of freedom
         for (unsigned int k = 0; k < s.size(); k++)
@@ -0,0 +1,250 @@
+// This file contains the direct (Born-Oppenheimer) solver of the induced charges
+
+#include "polarization_solver.h"
+#include "mpi_utility.h"
+
+bool PolarizationSolver::set_mode(const string &name) {
+    if (name == "cpmd")
+        mode = SOLVER_CPMD;
+    else if (name == "cholesky")
+        mode = SOLVER_CHOLESKY;
+    else if (name == "pcg")
+        mode = SOLVER_PCG;
+    else
+        return false;
+    return true;
+}
+
+const char *PolarizationSolver::mode_name() const {
+    if (mode == SOLVER_CHOLESKY)
+        return "cholesky";
+    if (mode == SOLVER_PCG)
+        return "pcg";
+    return "cpmd";
+}
+
+void PolarizationSolver::set_up(const OperatorStore &store) {
+
+    if (!direct())
+        return;
+
+    double start_time = omp_get_wtime();
+    operators = &store;
+    N = store.N;
+
+    if (mode == SOLVER_CHOLESKY) {
+        cholesky_factorize();
+    } else {
+        // the diagonal of S, from the rows of this process
+        vector<REAL> d(sizFVecMesh, 0.0);
+        for (unsigned int k = store.lower; k <= store.upper; k++)
+            d[k - store.lower] = -store.Kww(k)[k];
+        diagonal.assign(N, 0.0);
+        mesh_exchange.all_gather(&d[0], &diagonal[0]);
+    }
+
+    // the constraint direction is the same at every step
+    vector<REAL> ones(N, 1.0);
+    y1.assign(N, 0.0);
+    if (mode == SOLVER_CHOLESKY)
+        cholesky_solve(ones, y1);
+    else {
+        pcg(ones, y1, converged);
+        if (!converged && world.rank() == 0)
+            cout << "Polarization solver: pcg did not reach the tolerance " << tolerance << " for the constraint "
+                 << "direction in " << max_iterations << " iterations" << endl;
+    }
+    y0.assign(N, 0.0);
+
+    if (world.rank() == 0)
+        cout << "Polarization solver (" << mode_name() << ") set up in " << omp_get_wtime() - start_time << " s"
+             << endl;
+    return;
+}
+
+REAL PolarizationSolver::solve(const vector<REAL> &bw, REAL charge, vector<REAL> &x) {
+
+    vector<REAL> rhs(bw.begin(), bw.begin() + N);
+    if (mode == SOLVER_CHOLESKY)
+        cholesky_solve(rhs, y0);
+    else {
+        iterations = pcg(rhs, y0, converged);
+        total_iterations += iterations;
+        if (!converged) {
+            unconverged++;
+            if (unconverged == 1 && world.rank() == 0)
+                cout << "Polarization solver: pcg did not reach the tolerance " << tolerance << " in "
+                     << max_iterations << " iterations (solve " << solves + 1 << "); the induced charges of such "
+                     << "steps are not on the BO surface" << endl;
+        }
+    }
+    solves++;
+
+    // x = y0 - mu y1 with mu fixed by sum x = charge
+    REAL sum0 = 0, sum1 = 0;
+    for (unsigned int k = 0; k < N; k++) {
+        sum0 += y0[k];
+        sum1 += y1[k];
+    }
+    REAL mu = (sum0 - charge) / sum1;
+    x.resize(N);
+    for (unsigned int k = 0; k < N; k++)
+        x[k] = y0[k] - mu * y1[k];
+    return mu;
+}
+
+// the whole factor is held once per node, in shared memory: the first process of each node collects the rows
+// of Kww (broadcast by each process in turn) and factorizes them, the others of the node read the result
+void PolarizationSolver::cholesky_factorize() {
+
+    const OperatorStore &store = *operators;
+    vector<REAL> rows((size_t) sizFVecMesh * N, 0.0), scratch;
+    for (unsigned int k = store.lower; k <= store.upper; k++) {
+        const OPERATOR_REAL *Kwwk = store.Kww(k);
+        for (unsigned int l = 0; l < N; l++)
+            rows[(size_t) (k - store.lower) * N + l] = -Kwwk[l];
+    }
+    bool leader = node_communicator().rank() == 0;
+    factor.allocate(leader ? (size_t) N * N * sizeof(REAL) : 0);
+    L = (REAL *) factor.segment(0);
+
+    MPI_Datatype type = mpi::get_mpi_datatype<REAL>(REAL());
+    for (int p = 0; p < world.size(); p++) {
+        size_t values = (size_t) mesh_exchange.count(p) * N;
+        REAL *block = L + (size_t) mesh_exchange.lower(p) * N;
+        REAL *buffer;
+        if (world.rank() == p)
+            buffer = &rows[0];
+        else if (leader)
+            buffer = block;
+        else {
+            scratch.resize(values);
+            buffer = &scratch[0];
+        }
+        if (world.size() > 1)
+            MPI_Bcast(buffer, (int) values, type, p, world);
+        if (leader && world.rank() == p)
+            copy(rows.begin(), rows.end(), block);
+    }
+    // a failed factorization stops every process, not just the first of the node (the others would wait for it
+    // in synchronize)
+    int failed = 0;
+    if (leader)
+        failed = !cholesky_factorize_in_place();
+    MPI_Bcast(&failed, 1, MPI_INT, 0, node_communicator());
+    if (failed)
+        MPI_Abort(world, 1);
+    factor.synchronize();
+    if (world.rank() == 0)
+        cout << "Cholesky factor held once per node in shared memory (" << factor.bytes_on_node() / 1048576.0
+             << " MB)" << endl;
+    return;
+}
+
+// in place, row by row: L(i,j) = (S(i,j) - sum_m<j L(i,m) L(j,m)) / L(j,j); the upper triangle is zeroed
+bool PolarizationSolver::cholesky_factorize_in_place() {
+
+    for (unsigned int j = 0; j < N; j++) {
+        REAL *Lj = &L[(size_t) j * N];
+        REAL d = Lj[j];
+        for (unsigned int m = 0; m < j; m++)
+            d -= Lj[m] * Lj[m];
+        if (d <= 0) {
+            cout << "Polarization solver: the operator is not positive definite (pivot " << j << " is " << d
+                 << "); use --polarization_solver cpmd" << endl;
+            return false;
+        }
+        Lj[j] = sqrt(d);
+#pragma omp parallel for schedule(static) default(shared)
+        for (unsigned int i = j + 1; i < N; i++) {
+            REAL *Li = &L[(size_t) i * N];
+            REAL sum = Li[j];
+            for (unsigned int m = 0; m < j; m++)
+                sum -= Li[m] * Lj[m];
+            Li[j] = sum / Lj[j];
+        }
+        for (unsigned int m = j + 1; m < N; m++)
+            Lj[m] = 0;
+    }
+    return true;
+}
+
+// y = S^-1 b = L^-T L^-1 b
+void PolarizationSolver::cholesky_solve(const vector<REAL> &b, vector<REAL> &y) const {
+
+    y.resize(N);
+    for (unsigned int i = 0; i < N; i++) {
+        const REAL *Li = &L[(size_t) i * N];
+        REAL sum = b[i];
+        for (unsigned int m = 0; m < i; m++)
+            sum -= Li[m] * y[m];
+        y[i] = sum / Li[i];
+    }
+    for (int i = N - 1; i >= 0; i--) {
+        REAL sum = y[i];
+        for (unsigned int m = i + 1; m < N; m++)
+            sum -= L[(size_t) m * N + i] * y[m];
+        y[i] = sum / L[(size_t) i * N + i];
+    }
+    return;
+}
+
+void PolarizationSolver::multiply(const vector<REAL> &p, vector<REAL> &Sp) const {
+
+    const OperatorStore &store = *operators;
+    vector<REAL> local(sizFVecMesh, 0.0);
+#pragma omp parallel for schedule(static) default(shared)
+    for (unsigned int k = store.lower; k <= store.upper; k++) {
+        const OPERATOR_REAL *Kwwk = store.Kww(k);
+        REAL sum = 0;
+        for (unsigned int l = 0; l < N; l++)
+            sum += Kwwk[l] * p[l];
+        local[k - store.lower] = -sum;
+    }
+    Sp.resize(N);
+    mesh_exchange.all_gather(&local[0], &Sp[0]);
+    return;
+}
+
+// preconditioned conjugate gradient from the initial guess in y; the vectors are replicated on every
+// process, so only the matrix vector product communicates
+unsigned int PolarizationSolver::pcg(const vector<REAL> &b, vector<REAL> &y, bool &met) const {
+
+    vector<REAL> r(N), z(N), p(N), Sp(N);
+    multiply(y, Sp);
+    REAL bb = 0, rz = 0, rr = 0;
+    for (unsigned int k = 0; k < N; k++) {
+        r[k] = b[k] - Sp[k];
+        z[k] = r[k] / diagonal[k];
+        p[k] = z[k];
+        bb += b[k] * b[k];
+        rz += r[k] * z[k];
+        rr += r[k] * r[k];
+    }
+    REAL target = tolerance * tolerance * bb;
+
+    unsigned int iteration = 0;
+    while (rr > target && iteration < max_iterations) {
+        multiply(p, Sp);
+        REAL pSp = 0;
+        for (unsigned int k = 0; k < N; k++)
+            pSp += p[k] * Sp[k];
+        REAL alpha = rz / pSp;
+        REAL rz_new = 0;
+        rr = 0;
+        for (unsigned int k = 0; k < N; k++) {
+            y[k] += alpha * p[k];
+            r[k] -= alpha * Sp[k];
+            z[k] = r[k] / diagonal[k];
+            rz_new += r[k] * z[k];
+            rr += r[k] * r[k];
+        }
+        REAL beta = rz_new / rz;
+        rz = rz_new;
+        for (unsigned int k = 0; k < N; k++)
+            p[k] = z[k] + beta * p[k];
+        iteration++;
+    }
+    met = rr <= target;
+    return iteration;
+}
@@ -0,0 +1,80 @@
+// This is a header file for the direct (Born-Oppenheimer) solver of the induced charges
+// For a fixed mesh the energy functional is quadratic in x = w a with the constant operator S = -Kww,
+// so the induced charges on the BO surface solve the constrained linear system
+//      S x = bw - mu 1,    1^T x = total induced charge
+// where bw is the w independent part of the fake force and mu the Lagrange multiplier of the constraint.
+
+#ifndef _POLARIZATION_SOLVER_H
+#define _POLARIZATION_SOLVER_H
+
+#include <string>
+#include "utility.h"
+#include "operator_store.h"
+#include "node_memory.h"
+
+enum POLARIZATION_SOLVER_MODE {
+    SOLVER_CPMD = 0,        // fictitious dynamics of w (fmd warm-up, then cpmd)
+    SOLVER_CHOLESKY = 1,    // S factorized once, two triangular solves per step
+    SOLVER_PCG = 2          // Jacobi preconditioned CG, warm-started from the previous step
+};
+
+class PolarizationSolver {
+
+public:
+
+    POLARIZATION_SOLVER_MODE mode;
+    double tolerance;                // pcg: relative residual at convergence
+    unsigned int max_iterations;     // pcg: iteration cap per solve
+    unsigned int iterations;         // pcg: iterations of the last solve
+    unsigned long total_iterations;  // pcg: iterations of all solves
+    bool converged;                  // pcg: the last solve met the tolerance
+    unsigned long unconverged;       // pcg: solves stopped at max_iterations short of the tolerance
+    unsigned long solves;            // number of solves
+
+    PolarizationSolver() : mode(SOLVER_CPMD), tolerance(1e-10), max_iterations(1000), iterations(0),
+                           total_iterations(0), converged(true), unconverged(0), solves(0), N(0), operators(NULL),
+                           L(NULL) {}
+
+    // false if name is not one of cpmd, cholesky, pcg
+    bool set_mode(const string &name);
+
+    const char *mode_name() const;
+
+    // true if the induced charges are solved for instead of propagated
+    bool direct() const {
+        return mode != SOLVER_CPMD;
+    }
+
+    // setup stage, after the operator store is filled: factorize S (cholesky) or keep the local rows of
+    // Kww for the matrix vector products (pcg); also solves S y1 = 1 for the constraint
+    void set_up(const OperatorStore &);
+
+    // x = w a on the BO surface for the w independent fake force bw (all N entries) and the constraint
+    // sum x = charge; returns the Lagrange multiplier mu (the fake force at the solution is a scalefactor mu)
+    REAL solve(const vector<REAL> &bw, REAL charge, vector<REAL> &x);
+
+private:
+
+    unsigned int N;
+    const OperatorStore *operators;
+    REAL *L;                   // cholesky: lower triangular factor of S, row-major N x N, once per node
+    NodeMemory factor;         // holds L, in the segment of the first process of the node
+    vector<REAL> diagonal;     // pcg: diagonal of S (Jacobi preconditioner)
+    vector<REAL> y1;           // S^-1 1
+    vector<REAL> y0;           // S^-1 bw of the last solve (pcg warm start)
+
+    void cholesky_factorize();
+
+    // on the gathered S in L, by the first process of the node; false if S is not positive definite
+    bool cholesky_factorize_in_place();
+
+    void cholesky_solve(const vector<REAL> &, vector<REAL> &) const;
+
+    // Sp = S p with the rows shared out over the processes
+    void multiply(const vector<REAL> &, vector<REAL> &) const;
+
+    // returns the iterations; the last argument is false if max_iterations stopped it short of the tolerance
+    unsigned int pcg(const vector<REAL> &, vector<REAL> &, bool &) const;
+};
+
+#endif
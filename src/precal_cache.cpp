@@ -0,0 +1,103 @@
+// This is the operator cache builder.
+// It precalculates the interface operators for every grid in the infiles_* folders of the bin directory,
+// so that simulations on those meshes load them from the cache instead of recomputing them.
+// Usage (from the bin directory): ./precal_cache [bin directory] [cache directory]
+// Grids are shared out over MPI processes when launched with mpirun.
+
+#include "precalculations.h"
+#include "operator_cache.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+//MPI boundary parameters (required by the shared headers)
+unsigned int lowerBoundIons;
+unsigned int upperBoundIons;
+unsigned int sizFVecIons;
+unsigned int lowerBoundMesh;
+unsigned int upperBoundMesh;
+unsigned int sizFVecMesh;
+mpi::environment env;
+mpi::communicator world;
+Exchange mesh_exchange;
+Exchange ion_exchange;
+
+// list the entries of a directory
+static vector<string> list_directory(const string &path) {
+    vector<string> entries;
+    DIR *dir = opendir(path.c_str());
+    if (dir == NULL)
+        return entries;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+        entries.push_back(entry->d_name);
+    closedir(dir);
+    sort(entries.begin(), entries.end());
+    return entries;
+}
+
+int main(int argc, char *argv[]) {
+
+    string bin_dir = argc > 1 ? argv[1] : ".";
+    string cache_dir = argc > 2 ? argv[2] : bin_dir + "/opcache";
+    mkdir(cache_dir.c_str(), 0755);
+    mpi::communicator self(MPI_COMM_SELF, mpi::comm_attach);
+
+    // collect (folder, grid file, radius, shape id) for every infiles_a<radius>[_disk]/grid<N>.dat
+    vector<string> grid_files;
+    vector<double> radii;
+    vector<int> shape_ids;
+    vector<string> folders = list_directory(bin_dir);
+    for (unsigned int f = 0; f < folders.size(); f++) {
+        double radius;
+        if (sscanf(folders[f].c_str(), "infiles_a%lf", &radius) != 1)
+            continue;
+        int shape_id = folders[f].find("_disk") != string::npos ? 1 : 0;
+        vector<string> files = list_directory(bin_dir + "/" + folders[f]);
+        for (unsigned int g = 0; g < files.size(); g++) {
+            int number_of_vertices;
+            char expected[64];
+            if (sscanf(files[g].c_str(), "grid%d.dat", &number_of_vertices) != 1)
+                continue;
+            sprintf(expected, "grid%d.dat", number_of_vertices);
+            if (files[g] != expected)
+                continue;
+            grid_files.push_back(bin_dir + "/" + folders[f] + "/" + files[g]);
+            radii.push_back(radius);
+            shape_ids.push_back(shape_id);
+        }
+    }
+
+    if (world.rank() == 0)
+        cout << "Populating the operator cache " << cache_dir << " for " << grid_files.size() << " grids" << endl;
+
+    for (unsigned int g = world.rank(); g < grid_files.size(); g += world.size()) {
+        // read the mesh the same way NanoParticle::discretize does
+        vector<VERTEX> s;
+        ifstream in(grid_files[g].c_str(), ios::in);
+        unsigned int col1;
+        double col2, col3, col4, col5, col6, col7, col8;
+        while (in >> col1 >> col2 >> col3 >> col4 >> col5 >> col6 >> col7 >> col8)
+            s.push_back(VERTEX(VECTOR3D(col2, col3, col4), col5, VECTOR3D(col6, col7, col8), 1.0, 0.0));
+
+        uint64_t key = OperatorCache::make_key(grid_files[g], radii[g], shape_ids[g]);
+        string cache_file = OperatorCache::file_name(cache_dir, key);
+        OperatorCache cache;
+        if (cache.open(cache_file, key, s.size())) {
+            cout << grid_files[g] << " : already cached in " << cache_file << endl;
+            continue;
+        }
+
+        double start_time = omp_get_wtime();
+        // each grid is handled by a single process, which builds all rows
+        vector<long double> Gd, HT, P, Q;
+        build_interface_operators(self, s, radii[g], 0, s.size() - 1, Gd, HT, P, Q);
+        const long double *ops[CACHED_OPERATORS] = {&Gd[0], &HT[0], &P[0], &Q[0]};
+        if (OperatorCache::save(cache_file, key, s.size(), radii[g], shape_ids[g], ops))
+            cout << grid_files[g] << " : " << s.size() << " vertices cached in " << cache_file << " ("
+                 << omp_get_wtime() - start_time << " s)" << endl;
+        else
+            cout << grid_files[g] << " : could not write " << cache_file << endl;
+    }
+    return 0;
+}
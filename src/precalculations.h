@@ -7,7 +7,12 @@
 #include "NanoParticle.h"
 #include "functions.h"
 
-void precalculate(vector<VERTEX>&, NanoParticle *);
+// dense interface operators of a mesh (row-major): rows lower..upper of G, n.gradG (H transposed) and Q,
+// and all of P; the rows are shared out over the processes of the communicator
+void build_interface_operators(const mpi::communicator &, vector<VERTEX> &, double, unsigned int, unsigned int,
+                               vector<long double> &, vector<long double> &, vector<long double> &,
+                               vector<long double> &);
 
-#endif
+void precalculate(vector<VERTEX> &, NanoParticle *, const string &);
 
+#endif
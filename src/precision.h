@@ -0,0 +1,30 @@
+// This is a header file for the floating point precision policy of the engine
+// The policy is chosen at build time with the Makefile variable PRECISION (long, double or mixed)
+
+#ifndef _PRECISION_H
+#define _PRECISION_H
+
+// Storage : element type of the precalculated interface operators
+// Real : particle and vertex state, vectors and the accumulators of the force and energy sums
+// The operators themselves are always built (and cached) in long double and converted to Storage when loaded.
+template<typename Storage, typename Real>
+struct PRECISION_POLICY {
+    typedef Storage storage;
+    typedef Real real;
+};
+
+#if defined(PRECISION_DOUBLE)
+typedef PRECISION_POLICY<double, double> PRECISION;
+#define PRECISION_NAME "double"
+#elif defined(PRECISION_MIXED)
+typedef PRECISION_POLICY<float, double> PRECISION;
+#define PRECISION_NAME "mixed (float operator storage, double accumulation)"
+#else
+typedef PRECISION_POLICY<long double, long double> PRECISION;
+#define PRECISION_NAME "long double"
+#endif
+
+typedef PRECISION::real REAL;                    // state and accumulation
+typedef PRECISION::storage OPERATOR_REAL;        // operator storage
+
+#endif
@@ -0,0 +1,180 @@
+// This file contains the binary time series of the cpmd run
+
+#include "series.h"
+
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+template<typename T>
+static void put(string &s, const T &value) {
+    s.append((const char *) &value, sizeof(T));
+}
+
+void SeriesLog::set_up(const string &series_path, const vector<string> &names, unsigned int rows) {
+
+    path = series_path;
+    chunk_rows = rows > 0 ? rows : 1;
+    steps.clear();
+    columns.assign(names.size(), vector<double>());
+
+    SERIES_HEADER header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SERIES_MAGIC, sizeof(header.magic));
+    header.version = SERIES_VERSION;
+    header.columns = names.size() + 1;
+    header.chunk_rows = chunk_rows;
+    string start;
+    put(start, header);
+    SERIES_COLUMN column;
+    memset(&column, 0, sizeof(column));
+    strncpy(column.name, "step", sizeof(column.name) - 1);
+    column.type = SERIES_INT64;
+    put(start, column);
+    for (unsigned int c = 0; c < names.size(); c++) {
+        memset(&column, 0, sizeof(column));
+        strncpy(column.name, names[c].c_str(), sizeof(column.name) - 1);
+        column.type = SERIES_FLOAT64;
+        put(start, column);
+    }
+
+    // rows of an earlier part of the run are kept if the file has the same columns
+    ifstream in(path.c_str(), ios::in | ios::binary);
+    if (in) {
+        string found(start.size(), 0);
+        in.read(&found[0], found.size());
+        if (in && found == start) {
+            started = true;
+            return;
+        }
+    }
+    in.close();
+
+    output.write(path, start);
+    started = true;
+    return;
+}
+
+void SeriesLog::append(int64_t step, const vector<double> &values) {
+
+    if (!started)
+        return;
+    steps.push_back(step);
+    for (unsigned int c = 0; c < columns.size(); c++)
+        columns[c].push_back(c < values.size() ? values[c] : 0);
+    if (steps.size() == chunk_rows)
+        flush();
+    return;
+}
+
+void SeriesLog::flush() {
+
+    if (!started || steps.empty())
+        return;
+    SERIES_CHUNK chunk;
+    chunk.rows = steps.size();
+    string record;
+    record.reserve(sizeof(chunk) + chunk.rows * (columns.size() + 1) * sizeof(double));
+    put(record, chunk);
+    record.append((const char *) &steps[0], chunk.rows * sizeof(int64_t));
+    for (unsigned int c = 0; c < columns.size(); c++)
+        record.append((const char *) &columns[c][0], chunk.rows * sizeof(double));
+    output.append(path, record);
+    steps.clear();
+    for (unsigned int c = 0; c < columns.size(); c++)
+        columns[c].clear();
+    return;
+}
+
+bool SeriesReader::open(const string &path) {
+
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat file;
+    if (fstat(fd, &file) != 0 || (size_t) file.st_size < sizeof(SERIES_HEADER)) {
+        ::close(fd);
+        return false;
+    }
+    size = file.st_size;
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        size = 0;
+        return false;
+    }
+    data = (const char *) mapped;
+
+    memcpy(&header, data, sizeof(header));
+    uint64_t offset = sizeof(header) + (uint64_t) header.columns * sizeof(SERIES_COLUMN);
+    if (memcmp(header.magic, SERIES_MAGIC, sizeof(header.magic)) != 0 || header.version != SERIES_VERSION
+        || header.columns == 0 || offset > size) {
+        close();
+        return false;
+    }
+    columns.resize(header.columns);
+    memcpy(&columns[0], data + sizeof(header), header.columns * sizeof(SERIES_COLUMN));
+
+    // the whole chunks; a chunk still being written at the end of the file is left out
+    while (offset + sizeof(SERIES_CHUNK) <= size) {
+        SERIES_CHUNK chunk;
+        memcpy(&chunk, data + offset, sizeof(chunk));
+        uint64_t bytes = sizeof(chunk) + chunk.rows * header.columns * sizeof(double);
+        if (chunk.rows == 0 || offset + bytes > size)
+            break;
+        chunk_offsets.push_back(offset);
+        rows += chunk.rows;
+        offset += bytes;
+    }
+    return true;
+}
+
+bool SeriesReader::column(const string &name, vector<double> &values) const {
+
+    unsigned int c = 0;
+    while (c < columns.size() && name != columns[c].name)
+        c++;
+    if (c == columns.size())
+        return false;
+    column(c, values);
+    return true;
+}
+
+void SeriesReader::column(unsigned int c, vector<double> &values) const {
+
+    values.clear();
+    values.reserve(rows);
+    for (unsigned int k = 0; k < chunk_offsets.size(); k++) {
+        SERIES_CHUNK chunk;
+        memcpy(&chunk, data + chunk_offsets[k], sizeof(chunk));
+        const char *value = data + chunk_offsets[k] + sizeof(chunk) + c * chunk.rows * sizeof(double);
+        for (uint64_t r = 0; r < chunk.rows; r++, value += sizeof(double)) {
+            if (columns[c].type == SERIES_INT64) {
+                int64_t v;
+                memcpy(&v, value, sizeof(v));
+                values.push_back(v);
+            } else {
+                double v;
+                memcpy(&v, value, sizeof(v));
+                values.push_back(v);
+            }
+        }
+    }
+    return;
+}
+
+void SeriesReader::close() {
+
+    if (data != NULL)
+        munmap((void *) data, size);
+    data = NULL;
+    size = 0;
+    rows = 0;
+    columns.clear();
+    chunk_offsets.clear();
+    return;
+}
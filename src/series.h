@@ -0,0 +1,144 @@
+// This is a header file for the binary time series of the cpmd run (energies, temperatures, induced charge, tracks,
+// trust factors, density samples)
+// Each series is an append-only columnar file (native byte order, all fields 8 byte aligned):
+//   SERIES_HEADER, then one SERIES_COLUMN per column (the first is the step),
+//   then the chunks: a SERIES_CHUNK giving its rows, followed by the values of each column in turn (rows x 8 bytes).
+// Rows are gathered into chunks of up to chunk_rows and queued on the output manager when a chunk fills or the
+// series is flushed (at progress updates, checkpoints and the end of the run), so a chunk may be short.
+// A reader maps the file and takes a column as a stride through the chunks; nothing is parsed.
+// The text files (energy.dat etc.) are still written alongside unless --series_text false.
+
+#ifndef _SERIES_H
+#define _SERIES_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "output.h"
+
+using namespace std;
+
+const char SERIES_MAGIC[8] = {'N', 'P', 'S', 'E', 'R', 'I', 'E', 'S'};
+const uint32_t SERIES_VERSION = 1;
+
+enum SERIES_TYPE {
+    SERIES_INT64 = 0,
+    SERIES_FLOAT64 = 1
+};
+
+struct SERIES_HEADER {
+    char magic[8];
+    uint32_t version;
+    uint32_t columns;
+    uint32_t chunk_rows;            // most rows in a chunk
+    uint32_t reserved;
+};
+
+struct SERIES_COLUMN {
+    char name[24];
+    uint32_t type;                  // SERIES_TYPE
+    uint32_t reserved;
+};
+
+struct SERIES_CHUNK {
+    uint64_t rows;
+};
+
+// one series, written by the first process
+class SeriesLog {
+
+public:
+
+    SeriesLog(OutputManager &manager) : output(manager), started(false) {}
+
+    // a new series at path with a step column and float64 columns of the given names, or more rows for the series
+    // there if it has the same columns (a restart)
+    void set_up(const string &path, const vector<string> &names, unsigned int chunk_rows);
+
+    // the step and one value per float64 column
+    void append(int64_t step, const vector<double> &values);
+
+    // queues the rows gathered so far as a (short) chunk
+    void flush();
+
+private:
+
+    OutputManager &output;
+    string path;
+    bool started;
+    unsigned int chunk_rows;
+    vector<int64_t> steps;
+    vector<vector<double> > columns;
+};
+
+// the series of the cpmd run
+struct SERIES_LOGS {
+
+    SeriesLog energy;
+    SeriesLog temperature;
+    SeriesLog induced_charge;
+    SeriesLog track_density;
+    SeriesLog track_functional;
+    SeriesLog track_deviation;
+    SeriesLog trust_factor;         // running R and R_v
+    SeriesLog density;              // density of every bin at every sampling step
+    bool text;                      // also write the text files
+
+    SERIES_LOGS(OutputManager &manager) : energy(manager), temperature(manager), induced_charge(manager),
+                                          track_density(manager), track_functional(manager),
+                                          track_deviation(manager), trust_factor(manager), density(manager),
+                                          text(true) {}
+
+    void flush() {
+        energy.flush();
+        temperature.flush();
+        induced_charge.flush();
+        track_density.flush();
+        track_functional.flush();
+        track_deviation.flush();
+        trust_factor.flush();
+        density.flush();
+    }
+};
+
+extern SERIES_LOGS series;
+
+// a series file mapped into memory
+class SeriesReader {
+
+public:
+
+    SERIES_HEADER header;
+    vector<SERIES_COLUMN> columns;
+    uint64_t rows;
+
+    SeriesReader() : rows(0), data(NULL), size(0) {}
+
+    ~SeriesReader() {
+        close();
+    }
+
+    // false if the file is not a series
+    bool open(const string &path);
+
+    // the values of the named column (whole chunks only); false if there is no such column
+    bool column(const string &name, vector<double> &values) const;
+
+    // the values of column c (0 is the step)
+    void column(unsigned int c, vector<double> &values) const;
+
+    void close();
+
+private:
+
+    const char *data;
+    size_t size;
+    vector<uint64_t> chunk_offsets;
+
+    // the reader is not copied
+    SeriesReader(const SeriesReader &);
+
+    SeriesReader &operator=(const SeriesReader &);
+};
+
+#endif
@@ -0,0 +1,172 @@
+// This file contains the short-range (purely repulsive LJ) interactions and their neighbor list
+
+#include "short_range.h"
+#include "mpi_utility.h"
+
+void NeighborList::update(const ION_ARRAYS &a, unsigned int first, unsigned int last, double box_radius) {
+    if (start.empty() || first != lower || last != upper || needs_build(a)) {
+        lower = first;
+        upper = last;
+        build(a, box_radius);
+    }
+    return;
+}
+
+// any ion can be a neighbor of the ions held, so every displacement is checked
+bool NeighborList::needs_build(const ION_ARRAYS &a) const {
+    if (x0.size() != a.n)
+        return true;
+    double limit2 = 0.25 * skin * skin;
+    for (unsigned int j = 0; j < a.n; j++) {
+        double dx = a.x[j] - x0[j], dy = a.y[j] - y0[j], dz = a.z[j] - z0[j];
+        if (dx * dx + dy * dy + dz * dz > limit2)
+            return true;
+    }
+    return false;
+}
+
+void NeighborList::build(const ION_ARRAYS &a, double box_radius) {
+
+    double dmax = 0;
+    for (unsigned int j = 0; j < a.n; j++)
+        dmax = max(dmax, a.diameter[j]);
+    list_radius = dcut * dmax + skin;
+    double list2 = list_radius * list_radius;
+
+    // cubic cells of at least the list radius over the box; ions are binned with head / next chains
+    double width = 2 * box_radius;
+    int nc = max(1, int(width / list_radius));
+    double cell = width / nc;
+    vector<int> head(nc * nc * nc, -1), next(a.n, -1), cx(a.n), cy(a.n), cz(a.n);
+    for (unsigned int j = 0; j < a.n; j++) {
+        cx[j] = min(nc - 1, max(0, int((a.x[j] + box_radius) / cell)));
+        cy[j] = min(nc - 1, max(0, int((a.y[j] + box_radius) / cell)));
+        cz[j] = min(nc - 1, max(0, int((a.z[j] + box_radius) / cell)));
+        int c = (cx[j] * nc + cy[j]) * nc + cz[j];
+        next[j] = head[c];
+        head[c] = j;
+    }
+
+    // two passes over the 27 surrounding cells: count, then fill
+    int rows = upper - lower + 1;
+    start.assign(rows + 1, 0);
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            for (int r = 0; r < rows; r++)
+                start[r + 1] += start[r];
+            neighbors.resize(start[rows]);
+        }
+#pragma omp parallel for schedule(dynamic) default(shared)
+        for (int r = 0; r < rows; r++) {
+            unsigned int i = lower + r;
+            unsigned int found = 0;
+            for (int ix = max(0, cx[i] - 1); ix <= min(nc - 1, cx[i] + 1); ix++)
+                for (int iy = max(0, cy[i] - 1); iy <= min(nc - 1, cy[i] + 1); iy++)
+                    for (int iz = max(0, cz[i] - 1); iz <= min(nc - 1, cz[i] + 1); iz++)
+                        for (int j = head[(ix * nc + iy) * nc + iz]; j != -1; j = next[j]) {
+                            if ((unsigned int) j == i)
+                                continue;
+                            double dx = a.x[i] - a.x[j], dy = a.y[i] - a.y[j], dz = a.z[i] - a.z[j];
+                            if (dx * dx + dy * dy + dz * dz >= list2)
+                                continue;
+                            if (pass == 1)
+                                neighbors[start[r] + found] = j;
+                            found++;
+                        }
+            if (pass == 0)
+                start[r + 1] = found;
+        }
+    }
+
+    x0 = a.x;
+    y0 = a.y;
+    z0 = a.z;
+    builds++;
+    return;
+}
+
+// purely repulsive LJ between centres r2 apart with contact distance d: force f (r_i - r_j) and energy u
+static inline bool wca(double r2, double d, double &f, double &u) {
+    double d2 = d * d;
+    if (r2 >= dcut * dcut * d2)
+        return false;
+    double s2 = d2 / r2;
+    double s6 = s2 * s2 * s2;
+    f = 48 * (s6 * s6 - 0.5 * s6) / r2;
+    u = 4 * s6 * (s6 - 1) + 1;
+    return true;
+}
+
+// all LJ terms of ion i: its neighbors (energy counted half) and the walls, each wall being a dummy particle
+// of the same diameter placed radially at image_radius
+static void ion_short_range(NanoParticle *nanoParticle, const ION_ARRAYS &a, unsigned int i, double force[3],
+                            double &energy) {
+    double xi = a.x[i], yi = a.y[i], zi = a.z[i], di = a.diameter[i];
+    double f, u;
+    force[0] = force[1] = force[2] = 0;
+    energy = 0;
+
+    for (const unsigned int *j = neighbor_list.begin(i); j != neighbor_list.end(i); ++j) {
+        double dx = xi - a.x[*j], dy = yi - a.y[*j], dz = zi - a.z[*j];
+        if (wca(dx * dx + dy * dy + dz * dz, 0.5 * (di + a.diameter[*j]), f, u)) {
+            force[0] += f * dx;
+            force[1] += f * dy;
+            force[2] += f * dz;
+            energy += 0.5 * u;
+        }
+    }
+
+    double r = sqrt(xi * xi + yi * yi + zi * zi);
+    double image_radius[3];
+    int walls = 0;
+    if (r >= nanoParticle->radius)                          // ion outside: dummy just beneath the interface
+        image_radius[walls++] = nanoParticle->radius - 0.5 * di;
+    image_radius[walls++] = nanoParticle->box_radius + 0.5 * di;    // dummy just above the simulation box
+    if (r <= nanoParticle->radius)                          // ion inside: dummy just above the interface
+        image_radius[walls++] = nanoParticle->radius + 0.5 * di;
+    for (int w = 0; w < walls; w++) {
+        double scale = 1 - image_radius[w] / r;
+        double dr = r - image_radius[w];
+        if (wca(dr * dr, di, f, u)) {
+            force[0] += f * scale * xi;
+            force[1] += f * scale * yi;
+            force[2] += f * scale * zi;
+            energy += u;
+        }
+    }
+    return;
+}
+
+double short_range_forces(NanoParticle *nanoParticle, vector<VECTOR3D> &lj) {
+    neighbor_list.update(ion_arrays, lowerBoundIons, upperBoundIons, nanoParticle->box_radius);
+    int rows = upperBoundIons - lowerBoundIons + 1;
+    vector<double> energies(rows);
+#pragma omp parallel for schedule(dynamic) default(shared)
+    for (int r = 0; r < rows; r++) {
+        double force[3];
+        ion_short_range(nanoParticle, ion_arrays, lowerBoundIons + r, force, energies[r]);
+        lj[r] = VECTOR3D(force[0], force[1], force[2]);
+        // the interface exchange of the force routine in flight meanwhile (if any) is advanced by the master thread
+        if (omp_get_thread_num() == 0)
+            mesh_exchange.progress();
+    }
+    double total = 0;
+    for (int r = 0; r < rows; r++)
+        total += energies[r];
+    return total;
+}
+
+double short_range_energy(NanoParticle *nanoParticle) {
+    neighbor_list.update(ion_arrays, lowerBoundIons, upperBoundIons, nanoParticle->box_radius);
+    int rows = upperBoundIons - lowerBoundIons + 1;
+    vector<double> energies(rows);
+#pragma omp parallel for schedule(dynamic) default(shared)
+    for (int r = 0; r < rows; r++) {
+        double force[3];
+        ion_short_range(nanoParticle, ion_arrays, lowerBoundIons + r, force, energies[r]);
+    }
+    double total = 0;
+    for (int r = 0; r < rows; r++)
+        total += energies[r];
+    return total;
+}
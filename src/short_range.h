@@ -0,0 +1,54 @@
+// This is a header file for the short-range (purely repulsive LJ) interactions
+// The ion - ion pairs come from a cell list plus Verlet skin neighbor list over the spherical box; the pair
+// and wall (interface, box) terms of an ion are summed in one parallel pass
+
+#ifndef _SHORT_RANGE_H
+#define _SHORT_RANGE_H
+
+#include "NanoParticle.h"
+#include "ion_pairs.h"
+
+class NeighborList {
+
+public:
+
+    double skin;              // list radius beyond the largest LJ cutoff
+    unsigned long builds;     // number of times the list was built
+
+    NeighborList() : skin(0.3), builds(0), lower(0), upper(0), list_radius(0) {}
+
+    // neighbors of ions lower..upper within the LJ cutoff plus the skin; rebuilt when the ion range changes
+    // or some ion has moved more than half the skin since the last build
+    void update(const ION_ARRAYS &, unsigned int lower, unsigned int upper, double box_radius);
+
+    const unsigned int *begin(unsigned int i) const {
+        return neighbors.data() + start[i - lower];
+    }
+
+    const unsigned int *end(unsigned int i) const {
+        return neighbors.data() + start[i - lower + 1];
+    }
+
+private:
+
+    unsigned int lower, upper;
+    double list_radius;
+    vector<unsigned int> start;        // neighbors of ion i are neighbors[start[i - lower] .. start[i - lower + 1])
+    vector<unsigned int> neighbors;
+    vector<double> x0, y0, z0;         // positions at the last build
+
+    bool needs_build(const ION_ARRAYS &) const;
+
+    void build(const ION_ARRAYS &, double box_radius);
+};
+
+extern NeighborList neighbor_list;
+
+// LJ forces (pairs and walls) on ions lowerBoundIons..upperBoundIons, stored at i - lowerBoundIons;
+// returns their LJ energy (the same sum as short_range_energy)
+double short_range_forces(NanoParticle *, vector<VECTOR3D> &);
+
+// LJ energy of ions lowerBoundIons..upperBoundIons (pairs counted half on each ion)
+double short_range_energy(NanoParticle *);
+
+#endif
@@ -0,0 +1,252 @@
+// This file contains the tabulated field of the fixed charges on the interface
+
+#include <random>
+#include "surface_field.h"
+#include "mpi_utility.h"
+
+// the periodic phi grid has to close on itself, so pi is taken to full precision here
+static const double PI = acos(-1.0);
+
+bool SurfaceField::set_mode(const string &name) {
+    if (name == "direct")
+        mode = SURFACE_FIELD_DIRECT;
+    else if (name == "table")
+        mode = SURFACE_FIELD_TABLE;
+    else
+        return false;
+    return true;
+}
+
+const char *SurfaceField::mode_name() const {
+    return mode == SURFACE_FIELD_TABLE ? "table" : "direct";
+}
+
+void SurfaceField::set_up(const vector<VERTEX> &s, double box_radius) {
+
+    x.clear();
+    y.clear();
+    z.clear();
+    q.clear();
+    double area = 0, total = 0, r_min = 1e300, r_max = 0, r_mean = 0;
+    for (unsigned int k = 0; k < s.size(); k++) {
+        area += s[k].a;
+        VECTOR3D p = s[k].posvec;
+        double r = p.GetMagnitude();
+        r_min = min(r_min, r);
+        r_max = max(r_max, r);
+        r_mean += r / s.size();
+        if (s[k].realQ == 0)
+            continue;
+        x.push_back(p.x);
+        y.push_back(p.y);
+        z.push_back(p.z);
+        q.push_back(s[k].realQ);
+        total += fabs(s[k].realQ);
+    }
+    outside = SURFACE_FIELD_GRID();
+    inside = SURFACE_FIELD_GRID();
+    if (mode == SURFACE_FIELD_DIRECT || q.empty())
+        return;
+
+    double start_time = omp_get_wtime();
+    scale_potential = total / r_mean;
+    scale_field = total / (r_mean * r_mean);
+
+    // ions within a gap of about one mesh spacing of the interface are summed directly; where the grid would
+    // need more than max_nodes for the tolerance, the gap is widened
+    double spacing = sqrt(area / s.size());
+    double r_box = box_radius + 1;
+    double error_outside = 0, error_inside = 0;
+    for (double gap = spacing; r_max + gap < r_box; gap *= 2)
+        if (build(outside, true, r_max + gap, r_box, r_max + gap, 0.25 * gap, error_outside))
+            break;
+    for (double gap = spacing; r_min - gap > gap; gap *= 2)
+        if (build(inside, false, 0, r_min - gap, r_min - gap, 0.25 * gap, error_inside))
+            break;
+
+    if (world.rank() == 0) {
+        cout << "Surface charge field tabulated in " << omp_get_wtime() - start_time << " s" << endl;
+        if (outside.r_hi > 0)
+            cout << "   for r >= " << outside.r_lo << " on " << outside.values.size() / 4
+                 << " nodes, largest relative error " << error_outside << endl;
+        if (inside.r_hi > 0)
+            cout << "   for r <= " << inside.r_hi << " on " << inside.values.size() / 4
+                 << " nodes, largest relative error " << error_inside << endl;
+        cout << "   direct sum over the vertices elsewhere" << endl;
+    }
+    return;
+}
+
+void SurfaceField::direct(REAL px, REAL py, REAL pz, REAL &potential, REAL field[3]) const {
+    potential = field[0] = field[1] = field[2] = 0;
+    for (unsigned int k = 0; k < q.size(); k++) {
+        REAL dx = px - x[k], dy = py - y[k], dz = pz - z[k];
+        REAL G = 1.0 / sqrt(dx * dx + dy * dy + dz * dz);
+        REAL qG3 = q[k] * G * G * G;
+        potential += q[k] * G;
+        field[0] += qG3 * dx;
+        field[1] += qG3 * dy;
+        field[2] += qG3 * dz;
+    }
+}
+
+void SurfaceField::evaluate(const VECTOR3D &r, REAL &potential, VECTOR3D &field) const {
+    REAL p = sqrt(r.x * r.x + r.y * r.y + r.z * r.z);
+    const SURFACE_FIELD_GRID *grid = outside.covers(p) ? &outside : (inside.covers(p) ? &inside : NULL);
+    if (grid) {
+        double out[4];
+        interpolate(*grid, r.x, r.y, r.z, p, out);
+        potential = out[0];
+        field = VECTOR3D(out[1], out[2], out[3]);
+    } else {
+        REAL f[3];
+        direct(r.x, r.y, r.z, potential, f);
+        field = VECTOR3D(f[0], f[1], f[2]);
+    }
+}
+
+// node (a, b, c) is at c = c_lo + (a - 1) dc, theta = (b - 1) dtheta, phi = c dphi; the ghost nodes beyond
+// theta = 0, pi (and r = 0 inside) are the mirrored points, so they need no special treatment.
+// The nodes of one (r, theta) ring are summed together, in double, with the vertices in the outer loop.
+void SurfaceField::fill(SURFACE_FIELD_GRID &g) const {
+    g.values.assign((size_t) g.nc * g.ntheta * g.nphi * 4, 0.0);
+    vector<double> xd(x.begin(), x.end()), yd(y.begin(), y.end()), zd(z.begin(), z.end()), qd(q.begin(), q.end());
+    int rings = g.nc * g.ntheta;
+#pragma omp parallel for schedule(dynamic) default(shared)
+    for (int ring = 0; ring < rings; ring++) {
+        unsigned int a = ring / g.ntheta, b = ring % g.ntheta;
+        double c = g.c_lo + ((int) a - 1) * g.dc;
+        double r = g.logarithmic ? exp(c) : c;
+        double theta = ((int) b - 1) * g.dtheta;
+        unsigned int m = g.nphi;
+        vector<double> px(m), py(m), pz(m), potential(m, 0.0), fx(m, 0.0), fy(m, 0.0), fz(m, 0.0);
+        for (unsigned int n = 0; n < m; n++) {
+            px[n] = r * sin(theta) * cos(n * g.dphi);
+            py[n] = r * sin(theta) * sin(n * g.dphi);
+            pz[n] = r * cos(theta);
+        }
+        for (unsigned int k = 0; k < qd.size(); k++)
+            for (unsigned int n = 0; n < m; n++) {
+                double dx = px[n] - xd[k], dy = py[n] - yd[k], dz = pz[n] - zd[k];
+                double G = 1.0 / sqrt(dx * dx + dy * dy + dz * dz);
+                double qG3 = qd[k] * G * G * G;
+                potential[n] += qd[k] * G;
+                fx[n] += qG3 * dx;
+                fy[n] += qG3 * dy;
+                fz[n] += qG3 * dz;
+            }
+        double *v = &g.values[(size_t) ring * m * 4];
+        for (unsigned int n = 0; n < m; n++) {
+            v[4 * n] = potential[n];
+            v[4 * n + 1] = fx[n];
+            v[4 * n + 2] = fy[n];
+            v[4 * n + 3] = fz[n];
+        }
+    }
+}
+
+// cubic Lagrange weights of the nodes -1, 0, 1, 2 at t in [0, 1]
+static inline void lagrange(double t, double w[4]) {
+    w[0] = -t * (t - 1) * (t - 2) / 6;
+    w[1] = (t + 1) * (t - 1) * (t - 2) / 2;
+    w[2] = -(t + 1) * t * (t - 2) / 2;
+    w[3] = (t + 1) * t * (t - 1) / 6;
+}
+
+void SurfaceField::interpolate(const SURFACE_FIELD_GRID &g, double px, double py, double pz, double r,
+                               double out[4]) const {
+    double c = g.logarithmic ? log(r) : r;
+    double theta = r > 0 ? acos(max(-1.0, min(1.0, pz / r))) : 0;
+    double phi = atan2(py, px);
+    if (phi < 0)
+        phi += 2 * PI;
+
+    double tc = (c - g.c_lo) / g.dc, tt = theta / g.dtheta, tp = phi / g.dphi;
+    int ic = min(max(int(tc), 0), (int) g.nc - 4);
+    int it = min(max(int(tt), 0), (int) g.ntheta - 4);
+    int ip = min(int(tp), (int) g.nphi - 1);
+    double wc[4], wt[4], wp[4];
+    lagrange(tc - ic, wc);
+    lagrange(tt - it, wt);
+    lagrange(tp - ip, wp);
+
+    unsigned int columns[4];
+    for (int n = 0; n < 4; n++)
+        columns[n] = (ip - 1 + n + g.nphi) % g.nphi;
+
+    out[0] = out[1] = out[2] = out[3] = 0;
+    for (int a = 0; a < 4; a++)
+        for (int b = 0; b < 4; b++) {
+            const double *row = &g.values[((size_t) (ic + a) * g.ntheta + it + b) * g.nphi * 4];
+            double wab = wc[a] * wt[b];
+            for (int n = 0; n < 4; n++) {
+                const double *v = row + columns[n] * 4;
+                double w = wab * wp[n];
+                out[0] += w * v[0];
+                out[1] += w * v[1];
+                out[2] += w * v[2];
+                out[3] += w * v[3];
+            }
+        }
+}
+
+double SurfaceField::validate(const SURFACE_FIELD_GRID &g, unsigned int seed) const {
+    const int points = 2000;
+    mt19937 generator(seed);
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    vector<double> px(points), py(points), pz(points), pr(points);
+    double c_lo = g.logarithmic ? log(g.r_lo) : g.r_lo, c_hi = g.logarithmic ? log(g.r_hi) : g.r_hi;
+    for (int n = 0; n < points; n++) {
+        double c = c_lo + (c_hi - c_lo) * uniform(generator);
+        double r = g.logarithmic ? exp(c) : c;
+        double cos_theta = 2 * uniform(generator) - 1, phi = 2 * PI * uniform(generator);
+        double sin_theta = sqrt(1 - cos_theta * cos_theta);
+        px[n] = r * sin_theta * cos(phi);
+        py[n] = r * sin_theta * sin(phi);
+        pz[n] = r * cos_theta;
+        pr[n] = r;
+    }
+
+    double error = 0;
+#pragma omp parallel for schedule(static) default(shared) reduction(max:error)
+    for (int n = 0; n < points; n++) {
+        double out[4];
+        interpolate(g, px[n], py[n], pz[n], pr[n], out);
+        REAL potential, field[3];
+        direct(px[n], py[n], pz[n], potential, field);
+        double ex = out[1] - field[0], ey = out[2] - field[1], ez = out[3] - field[2];
+        double dphi = fabs(out[0] - (double) potential), dE = sqrt(ex * ex + ey * ey + ez * ez);
+        error = max(error, max(dphi / scale_potential, dE / scale_field));
+    }
+    return error;
+}
+
+bool SurfaceField::build(SURFACE_FIELD_GRID &g, bool logarithmic, double r_lo, double r_hi, double r_sharp,
+                         double h, double &error) const {
+    g.logarithmic = logarithmic;
+    g.r_lo = r_lo;
+    g.r_hi = r_hi;
+    g.c_lo = logarithmic ? log(r_lo) : r_lo;
+    double c_hi = logarithmic ? log(r_hi) : r_hi;
+    for (;;) {
+        unsigned int mc = max(1, (int) ceil((c_hi - g.c_lo) / (logarithmic ? h / r_sharp : h)));
+        unsigned int mtheta = max(4, (int) ceil(PI * r_sharp / h));
+        unsigned int mphi = max(8, (int) ceil(2 * PI * r_sharp / h));
+        if ((double) (mc + 3) * (mtheta + 3) * mphi > max_nodes) {
+            g = SURFACE_FIELD_GRID();
+            return false;
+        }
+        g.dc = (c_hi - g.c_lo) / mc;
+        g.dtheta = PI / mtheta;
+        g.dphi = 2 * PI / mphi;
+        g.nc = mc + 3;
+        g.ntheta = mtheta + 3;
+        g.nphi = mphi;
+        fill(g);
+        error = validate(g, mc * 7919 + mtheta);
+        if (error <= tolerance)
+            return true;
+        // cubic interpolation: the error goes as h^4
+        h = min(0.7 * h, 0.9 * h * pow(tolerance / error, 0.25));
+    }
+}
@@ -0,0 +1,80 @@
+// This is a header file for the field of the fixed (bare) charges realQ on the interface
+// realQ does not change during a run, so away from the interface its potential and field can be tabulated
+// once, on grids in spherical coordinates about the centre (logarithmic in r outside the interface, linear
+// inside), and interpolated per ion; ions close to the interface, where the field of the discrete charges
+// varies on the scale of the mesh, keep the direct sum over the vertices.
+// The grids are refined at set-up until the interpolation error on random points is below the tolerance.
+
+#ifndef _SURFACE_FIELD_H
+#define _SURFACE_FIELD_H
+
+#include <string>
+#include "vertex.h"
+
+enum SURFACE_FIELD_MODE {
+    SURFACE_FIELD_DIRECT = 0,    // sum over the vertices for every ion
+    SURFACE_FIELD_TABLE = 1      // tabulated away from the interface, direct sum near it
+};
+
+// potential and field (4 values per node) on a grid in (c, theta, phi) with c = ln r or r;
+// one ghost node below and two above in c and theta for the cubic stencils, phi is periodic
+struct SURFACE_FIELD_GRID {
+    bool logarithmic;
+    double r_lo, r_hi;                   // radial range covered
+    double c_lo, dc, dtheta, dphi;
+    unsigned int nc, ntheta, nphi;       // stored nodes
+    vector<double> values;
+
+    SURFACE_FIELD_GRID() : logarithmic(false), r_lo(0), r_hi(-1), c_lo(0), dc(0), dtheta(0), dphi(0), nc(0),
+                           ntheta(0), nphi(0) {}
+
+    bool covers(double r) const {
+        return r >= r_lo && r <= r_hi;
+    }
+};
+
+class SurfaceField {
+
+public:
+
+    SURFACE_FIELD_MODE mode;
+    double tolerance;                // largest interpolation error, relative to the potential and field at the interface
+    unsigned int max_nodes;          // cap on the nodes of one grid
+
+    SurfaceField() : mode(SURFACE_FIELD_DIRECT), tolerance(1e-5), max_nodes(1 << 21), scale_potential(0),
+                     scale_field(0) {}
+
+    // false if name is not one of direct, table
+    bool set_mode(const string &name);
+
+    const char *mode_name() const;
+
+    // keeps the charged vertices and, in table mode, builds the grids for the ions outside the interface
+    // (up to the box radius) and inside it
+    void set_up(const vector<VERTEX> &, double box_radius);
+
+    // potential sum_k realQ_k / |r - s_k| and field sum_k realQ_k (r - s_k) / |r - s_k|^3 at r
+    void evaluate(const VECTOR3D &r, REAL &potential, VECTOR3D &field) const;
+
+private:
+
+    vector<REAL> x, y, z, q;            // charged vertices
+    double scale_potential, scale_field;
+    SURFACE_FIELD_GRID outside, inside;
+
+    void direct(REAL px, REAL py, REAL pz, REAL &potential, REAL field[3]) const;
+
+    void fill(SURFACE_FIELD_GRID &) const;
+
+    void interpolate(const SURFACE_FIELD_GRID &, double px, double py, double pz, double r, double out[4]) const;
+
+    // largest error of the grid on random points of its range, relative to the interface scales
+    double validate(const SURFACE_FIELD_GRID &, unsigned int seed) const;
+
+    // grids of spacing h (at the radius where the field varies fastest) over [r_lo, r_hi], refined until
+    // the tolerance is met; false if that takes more than max_nodes
+    bool build(SURFACE_FIELD_GRID &, bool logarithmic, double r_lo, double r_hi, double r_sharp, double h,
+               double &error) const;
+};
+
+#endif
@@ -0,0 +1,61 @@
+// This is the trajectory converter.
+// It writes a binary trajectory (outfiles/p.traj) as the LAMMPS text dump that OVITO reads, the same as the
+// outfiles/p.lammpstrj written with --movie_format lammpstrj (coordinates and energies to float32 precision).
+// Usage: ./traj2lammpstrj [trajectory] [lammpstrj] [first frame] [last frame]
+// The frames are found through the index, so a range of frames is converted without reading the ones before.
+
+#include "trajectory.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+int main(int argc, char *argv[]) {
+
+    string trajectory = argc > 1 ? argv[1] : "outfiles/p.traj";
+    string lammpstrj = argc > 2 ? argv[2] : "outfiles/p.lammpstrj";
+
+    TrajectoryReader reader;
+    if (!reader.open(trajectory)) {
+        cout << "File " << trajectory << " is not a trajectory" << endl;
+        return 1;
+    }
+    unsigned int first = argc > 3 ? atoi(argv[3]) : 0;
+    unsigned int last = argc > 4 ? atoi(argv[4]) : reader.index.size() - 1;
+    if (last >= reader.index.size())
+        last = reader.index.size() - 1;
+
+    ofstream outdump(lammpstrj.c_str(), ios::out);
+    if (!outdump) {
+        cout << "File " << lammpstrj << " could not be opened" << endl;
+        return 1;
+    }
+
+    double box_radius = reader.header.box_radius;
+    vector<float> xyz, es, ke;
+    unsigned int frames = 0;
+    for (unsigned int n = first; n <= last && n < reader.index.size(); n++) {
+        if (!reader.read_frame(n, xyz, es, ke)) {
+            cout << "Frame " << n << " of " << trajectory << " could not be read" << endl;
+            return 1;
+        }
+        outdump << "ITEM: TIMESTEP" << endl;
+        outdump << reader.index[n].step << endl;
+        outdump << "ITEM: NUMBER OF ATOMS" << endl;
+        outdump << reader.header.ions << endl;
+        outdump << "ITEM: BOX BOUNDS" << endl;
+        outdump << -box_radius << "\t" << box_radius << endl;
+        outdump << -box_radius << "\t" << box_radius << endl;
+        outdump << -box_radius << "\t" << box_radius << endl;
+        outdump << "ITEM: ATOMS index type x y z ES KE" << endl;
+        for (unsigned int i = 0; i < reader.header.ions; i++) {
+            string type = reader.types[i] > 0 ? "1" : "-1";
+            outdump << setw(6) << i << "\t" << type << "\t" << setw(8) << xyz[3 * i] << "\t" << setw(8)
+                    << xyz[3 * i + 1] << "\t" << setw(8) << xyz[3 * i + 2] << "\t" << es[i] << "\t" << ke[i] << endl;
+        }
+        frames++;
+    }
+    outdump.close();
+
+    cout << "Converted " << frames << " frames of " << trajectory << " to " << lammpstrj << endl;
+    return 0;
+}
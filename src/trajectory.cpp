@@ -0,0 +1,221 @@
+// This file contains the binary trajectory of the ions
+
+#include "trajectory.h"
+
+#include <cmath>
+#include <cstring>
+#include <zlib.h>
+
+template<typename T>
+static void put(string &s, const T &value) {
+    s.append((const char *) &value, sizeof(T));
+}
+
+template<typename T>
+static void put(vector<char> &s, const T &value) {
+    s.insert(s.end(), (const char *) &value, (const char *) &value + sizeof(T));
+}
+
+// a coordinate in int16 fixed point over the box radius
+static int16_t quantize(double x, double box_radius) {
+    double q = floor(x / box_radius * 32767 + 0.5);
+    if (q > 32767)
+        q = 32767;
+    if (q < -32767)
+        q = -32767;
+    return (int16_t) q;
+}
+
+// the header and the types at the start of the file
+static string file_start(const TRAJECTORY_HEADER &header, const vector<int8_t> &types) {
+    string s;
+    put(s, header);
+    if (!types.empty())
+        s.append((const char *) &types[0], types.size());
+    return s;
+}
+
+void TrajectoryWriter::set_up(const string &trajectory, TRAJECTORY_COORDINATES coordinates, bool compressed,
+                              double box_radius, const vector<int8_t> &types) {
+
+    path = trajectory;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic));
+    header.version = TRAJECTORY_VERSION;
+    header.coordinates = coordinates;
+    header.compressed = compressed;
+    header.ions = types.size();
+    header.box_radius = box_radius;
+    string start = file_start(header, types);
+
+    // frames of an earlier part of the run are kept if the file has the same start
+    ifstream in(path.c_str(), ios::in | ios::binary);
+    if (in) {
+        string found(start.size(), 0);
+        in.read(&found[0], found.size());
+        if (in && found == start) {
+            in.seekg(0, ios::end);
+            offset = in.tellg();
+            started = true;
+            return;
+        }
+    }
+    in.close();
+
+    output.write(path, start);
+    output.write(path + ".index", "");
+    offset = start.size();
+    started = true;
+    return;
+}
+
+void TrajectoryWriter::write_frame(int64_t step, const vector<double> &xyz, const vector<double> &es,
+                                   const vector<double> &ke) {
+
+    if (!started)
+        return;
+
+    raw.clear();
+    if (header.coordinates == TRAJECTORY_INT16)
+        for (unsigned int i = 0; i < xyz.size(); i++)
+            put(raw, quantize(xyz[i], header.box_radius));
+    else
+        for (unsigned int i = 0; i < xyz.size(); i++)
+            put(raw, (float) xyz[i]);
+    for (unsigned int i = 0; i < es.size(); i++)
+        put(raw, (float) es[i]);
+    for (unsigned int i = 0; i < ke.size(); i++)
+        put(raw, (float) ke[i]);
+
+    TRAJECTORY_FRAME frame;
+    frame.step = step;
+    frame.raw_bytes = raw.size();
+    frame.stored_bytes = raw.size();
+    const char *payload = &raw[0];
+
+    // deflated only when that makes the frame smaller
+    if (header.compressed) {
+        uLongf packed_bytes = compressBound(raw.size());
+        packed.resize(packed_bytes);
+        if (compress2((Bytef *) &packed[0], &packed_bytes, (const Bytef *) &raw[0], raw.size(), Z_BEST_SPEED) == Z_OK
+            && packed_bytes < raw.size()) {
+            frame.stored_bytes = packed_bytes;
+            payload = &packed[0];
+        }
+    }
+
+    string record;
+    put(record, frame);
+    record.append(payload, frame.stored_bytes);
+    output.append(path, record);
+
+    TRAJECTORY_INDEX entry;
+    entry.step = step;
+    entry.offset = offset;
+    string index_record;
+    put(index_record, entry);
+    output.append(path + ".index", index_record);
+
+    offset += record.size();
+    return;
+}
+
+bool TrajectoryReader::open(const string &path) {
+
+    in.open(path.c_str(), ios::in | ios::binary);
+    if (!in)
+        return false;
+    in.read((char *) &header, sizeof(header));
+    if (!in || memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic)) != 0
+        || header.version != TRAJECTORY_VERSION)
+        return false;
+    types.resize(header.ions);
+    if (header.ions > 0)
+        in.read((char *) &types[0], header.ions);
+    if (!in)
+        return false;
+    uint64_t first_frame = in.tellg();
+    in.seekg(0, ios::end);
+    uint64_t size = in.tellg();
+
+    // the index, up to its last entry that points at a whole frame
+    index.clear();
+    ifstream index_in((path + ".index").c_str(), ios::in | ios::binary);
+    TRAJECTORY_INDEX entry;
+    while (index_in.read((char *) &entry, sizeof(entry))) {
+        if (entry.offset < first_frame || entry.offset + sizeof(TRAJECTORY_FRAME) > size)
+            break;
+        index.push_back(entry);
+    }
+
+    // frames past the index (or all of them, without an index) are found by stepping through the file
+    uint64_t next = first_frame;
+    if (!index.empty()) {
+        TRAJECTORY_FRAME frame;
+        in.seekg(index.back().offset);
+        in.read((char *) &frame, sizeof(frame));
+        next = index.back().offset + sizeof(frame) + frame.stored_bytes;
+    }
+    while (next + sizeof(TRAJECTORY_FRAME) <= size) {
+        TRAJECTORY_FRAME frame;
+        in.seekg(next);
+        in.read((char *) &frame, sizeof(frame));
+        if (!in || next + sizeof(frame) + frame.stored_bytes > size)
+            break;
+        entry.step = frame.step;
+        entry.offset = next;
+        index.push_back(entry);
+        next += sizeof(frame) + frame.stored_bytes;
+    }
+    in.clear();
+    return true;
+}
+
+bool TrajectoryReader::read_frame(unsigned int n, vector<float> &xyz, vector<float> &es, vector<float> &ke) {
+
+    if (n >= index.size())
+        return false;
+
+    TRAJECTORY_FRAME frame;
+    in.clear();
+    in.seekg(index[n].offset);
+    in.read((char *) &frame, sizeof(frame));
+    unsigned int coordinate_bytes = header.coordinates == TRAJECTORY_INT16 ? sizeof(int16_t) : sizeof(float);
+    if (!in || frame.raw_bytes != header.ions * (3 * coordinate_bytes + 2 * sizeof(float)))
+        return false;
+    stored.resize(frame.stored_bytes);
+    if (frame.stored_bytes > 0)
+        in.read(&stored[0], frame.stored_bytes);
+    if (!in)
+        return false;
+
+    const char *payload = &stored[0];
+    if (frame.stored_bytes < frame.raw_bytes) {
+        raw.resize(frame.raw_bytes);
+        uLongf raw_bytes = frame.raw_bytes;
+        if (uncompress((Bytef *) &raw[0], &raw_bytes, (const Bytef *) &stored[0], frame.stored_bytes) != Z_OK
+            || raw_bytes != frame.raw_bytes)
+            return false;
+        payload = &raw[0];
+    }
+
+    unsigned int ions = header.ions;
+    xyz.resize(3 * ions);
+    es.resize(ions);
+    ke.resize(ions);
+    if (header.coordinates == TRAJECTORY_INT16) {
+        for (unsigned int i = 0; i < 3 * ions; i++) {
+            int16_t q;
+            memcpy(&q, payload, sizeof(q));
+            payload += sizeof(q);
+            xyz[i] = q * header.box_radius / 32767;
+        }
+    } else {
+        memcpy(&xyz[0], payload, 3 * ions * sizeof(float));
+        payload += 3 * ions * sizeof(float);
+    }
+    memcpy(&es[0], payload, ions * sizeof(float));
+    payload += ions * sizeof(float);
+    memcpy(&ke[0], payload, ions * sizeof(float));
+    return true;
+}
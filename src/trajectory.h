@@ -0,0 +1,102 @@
+// This is a header file for the binary trajectory (movie) of the ions
+// Layout of the trajectory file (native byte order):
+//   TRAJECTORY_HEADER, then one int8 type per ion (+1 / -1, the sign of the valency),
+//   then the frames: TRAJECTORY_FRAME followed by its payload. The payload holds x, y, z of all ions (float32, or
+//   int16 fixed point over the box radius), then the electrostatic and the kinetic energy of all ions (float32);
+//   it is deflated (zlib) when the file is compressed and that makes it smaller.
+// Each frame is also listed in the index file (trajectory file + ".index") as a TRAJECTORY_INDEX entry, which
+// gives random access to the frames without reading the ones before.
+// traj2lammpstrj converts a trajectory back to the LAMMPS text dump that make_movie used to write.
+
+#ifndef _TRAJECTORY_H
+#define _TRAJECTORY_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "output.h"
+
+using namespace std;
+
+const char TRAJECTORY_MAGIC[8] = {'N', 'P', 'T', 'R', 'A', 'J', 'E', 'C'};
+const uint32_t TRAJECTORY_VERSION = 1;
+
+enum TRAJECTORY_COORDINATES {
+    TRAJECTORY_FLOAT32 = 0,
+    TRAJECTORY_INT16 = 1            // x = q * box_radius / 32767
+};
+
+struct TRAJECTORY_HEADER {
+    char magic[8];
+    uint32_t version;
+    uint32_t coordinates;           // TRAJECTORY_COORDINATES
+    uint32_t compressed;            // payloads may be deflated
+    uint32_t ions;
+    double box_radius;
+};
+
+struct TRAJECTORY_FRAME {
+    int64_t step;                   // time step of the LAMMPS dump
+    uint32_t stored_bytes;          // payload in the file; deflated if less than raw_bytes
+    uint32_t raw_bytes;
+};
+
+struct TRAJECTORY_INDEX {
+    int64_t step;
+    uint64_t offset;                // of the TRAJECTORY_FRAME in the trajectory file
+};
+
+// frames queued on an output manager (first process only)
+class TrajectoryWriter {
+
+public:
+
+    TrajectoryWriter(OutputManager &manager) : output(manager), started(false), offset(0) {}
+
+    // a new trajectory at path, or more frames for the one there if it has the same header (a restart)
+    void set_up(const string &path, TRAJECTORY_COORDINATES, bool compressed, double box_radius,
+                const vector<int8_t> &types);
+
+    // frames are written (set up on the first process)
+    bool active() const {
+        return started;
+    }
+
+    // xyz holds x, y, z of each ion
+    void write_frame(int64_t step, const vector<double> &xyz, const vector<double> &es, const vector<double> &ke);
+
+private:
+
+    OutputManager &output;
+    string path;
+    TRAJECTORY_HEADER header;
+    bool started;
+    uint64_t offset;                // size of the file with the frames queued so far
+    vector<char> raw, packed;
+};
+
+extern TrajectoryWriter trajectory;
+
+// the frames of a trajectory file, read through its index (rebuilt by a scan if it is missing or short)
+class TrajectoryReader {
+
+public:
+
+    TRAJECTORY_HEADER header;
+    vector<int8_t> types;
+    vector<TRAJECTORY_INDEX> index;
+
+    // false if the file is not a trajectory
+    bool open(const string &path);
+
+    // frame n of the index; false if it cannot be read
+    bool read_frame(unsigned int n, vector<float> &xyz, vector<float> &es, vector<float> &ke);
+
+private:
+
+    ifstream in;
+    vector<char> stored, raw;
+};
+
+#endif
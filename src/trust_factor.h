@@ -0,0 +1,82 @@
+// This is a header file for the running MD trust factors R and R_v
+// R is the standard deviation of the extended energy over that of the ion kinetic energy, and R_v the same over
+// the fake kinetic energy. The energies of each extra computation step go into Welford accumulators (count, mean
+// and sum of squared deviations), so both factors are known at every step without keeping or re-reading the
+// samples, and the accumulators go into the checkpoint.
+
+#ifndef _TRUST_FACTOR_H
+#define _TRUST_FACTOR_H
+
+#include "utility.h"
+
+class RunningStatistics {
+
+private:
+    friend class boost::serialization::access;
+
+    template<class Archive>
+    void serialize(Archive &ar, const unsigned int version) {
+        ar & n;
+        ar & mean;
+        ar & m2;
+    }
+
+public:
+
+    double n;                   // samples
+    double mean;
+    double m2;                  // sum of squared deviations from the mean
+
+    RunningStatistics() : n(0), mean(0), m2(0) {}
+
+    void add(double x) {
+        n++;
+        double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+    }
+
+    // population standard deviation
+    double sd() const {
+        return n > 0 ? sqrt(m2 / n) : 0;
+    }
+};
+
+class TrustFactors {
+
+private:
+    friend class boost::serialization::access;
+
+    template<class Archive>
+    void serialize(Archive &ar, const unsigned int version) {
+        ar & extended;
+        ar & ke;
+        ar & fake_ke;
+    }
+
+public:
+
+    RunningStatistics extended;     // extended energy
+    RunningStatistics ke;           // ion kinetic energy
+    RunningStatistics fake_ke;      // fake kinetic energy
+
+    void add(double extended_energy, double particle_ke, double fake_kinetic_energy) {
+        extended.add(extended_energy);
+        ke.add(particle_ke);
+        fake_ke.add(fake_kinetic_energy);
+    }
+
+    // 0 until the kinetic energy has spread (at the first sample both deviations are 0)
+    double R() const {
+        return ke.sd() > 0 ? extended.sd() / ke.sd() : 0;
+    }
+
+    double R_v() const {
+        return fake_ke.sd() > 0 ? extended.sd() / fake_ke.sd() : 0;
+    }
+};
+
+// accumulated on the first process
+extern TrustFactors trust_factors;
+
+#endif
@@ -1,10 +1,14 @@
 // This is 3d vector class
 // VECTOR3D is a vector in cartesian coordinate system
+// VECTOR3D_T is templated on the component type; VECTOR3D uses the precision policy of the build
 
 #ifndef _VECTOR3D_H
 #define _VECTOR3D_H
 
-class VECTOR3D 
+#include "precision.h"
+
+template<typename T>
+class VECTOR3D_T 
 {
   private:
     friend class boost::serialization::access;
@@ -18,32 +22,32 @@ class VECTOR3D
     }
 
   public:
-    long double x, y, z;									// component along each axis (cartesian)
+    T x, y, z;									// component along each axis (cartesian)
 
-    VECTOR3D(long double xx = 0.0, long double yy = 0.0, long double zz = 0.0) : x(xx), y(yy), z(zz) 	// make a 3d vector
+    VECTOR3D_T(T xx = 0.0, T yy = 0.0, T zz = 0.0) : x(xx), y(yy), z(zz) 	// make a 3d vector
     {
     } 
-    long double GetMagnitude()								// magnitude of the vector
+    T GetMagnitude()								// magnitude of the vector
     {
       return sqrt(x*x + y*y +z*z);							
     }
-    VECTOR3D operator-(const VECTOR3D& vec)						// subtract two vectors
+    VECTOR3D_T operator-(const VECTOR3D_T& vec)						// subtract two vectors
     {
-      return VECTOR3D(x - vec.x, y - vec.y, z - vec.z);					
+      return VECTOR3D_T(x - vec.x, y - vec.y, z - vec.z);					
     }
-    long double operator*(const VECTOR3D& vec)						// dot product of two vectors
+    T operator*(const VECTOR3D_T& vec)						// dot product of two vectors
     {
       return x*vec.x + y*vec.y + z*vec.z;						
     }
-    VECTOR3D operator^(long double scalar)							// product of a vector and a scalar
+    VECTOR3D_T operator^(T scalar)							// product of a vector and a scalar
     {
-      return VECTOR3D(x*scalar, y*scalar, z*scalar);					
+      return VECTOR3D_T(x*scalar, y*scalar, z*scalar);					
     }
-    VECTOR3D operator+(const VECTOR3D& vec)						// add two vectors
+    VECTOR3D_T operator+(const VECTOR3D_T& vec)						// add two vectors
     {
-      return VECTOR3D(x + vec.x, y + vec.y, z + vec.z);					
+      return VECTOR3D_T(x + vec.x, y + vec.y, z + vec.z);					
     }
-    bool operator==(const VECTOR3D& vec)						// compare two vectors
+    bool operator==(const VECTOR3D_T& vec)						// compare two vectors
     {
       if (x==vec.x && y==vec.y && z==vec.z) 
 	return true;
@@ -51,4 +55,6 @@ class VECTOR3D
     } 
 };
 
+typedef VECTOR3D_T<REAL> VECTOR3D;
+
 #endif
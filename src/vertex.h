@@ -27,46 +27,24 @@ private:
         ar & ke;
         ar & pe;
         ar & wmean;
-        ar & presumgwEw;
-        ar & presumgEwEq;
-        ar & presumgEwEw;
-        ar & presumfwEw;
-        ar & presumfEwEq;
-        ar & presumhEqEw;
-        ar & Greens;
-        ar & ndotGradGreens;
-        ar & Gion;
-        ar & gradGion;
     }
 
 public:
 
     // members
     VECTOR3D posvec;            // position vector of the vertex
-    long double a;                // area of the vertex
+    REAL a;                // area of the vertex
     VECTOR3D normalvec;            // normal vector on the surface pointing interior to exterior
     double r, theta, phi;            // polar coordinates of the vertex
-    long double mu;                // 'mass' of the induced charge
-    long double w;                // discretized induced charge on the vertex
-    long double realQ;				// discretized induced charge on the vertex
-    long double vw;                // 'velocity' of the induced charge
-    long double fw;                // 'force' on the induced charge
-    long double ke;                    // 'kinetic energy' of the induced charge
+    REAL mu;                // 'mass' of the induced charge
+    REAL w;                // discretized induced charge on the vertex
+    REAL realQ;				// discretized induced charge on the vertex
+    REAL vw;                // 'velocity' of the induced charge
+    REAL fw;                // 'force' on the induced charge
+    REAL ke;                    // 'kinetic energy' of the induced charge
     double pe;                // potential energy of the fake degrees associated with vertices
     double wmean;                // mean w computed on fmd
 
-    // member vectors
-    vector<long double> presumgwEw;        // result of a precalculation-- gwEw
-    vector<long double> presumgEwEq;        // result of a precalculation-- gEwEq
-    vector<long double> presumgEwEw;        // result of a precalculation-- gEwEw
-    vector<long double> presumfwEw;        // result of a precalculation-- fwEw
-    vector<long double> presumfEwEq;        // result of a precalculation-- fwEw
-    vector<long double> presumhEqEw;        // result of a precalculation-- hEqEw
-    vector<long double> Greens;        // precalculate Gww
-    vector<long double> ndotGradGreens;    // precalculate n.gradGww
-    vector<long double> Gion;            // Greens function between induced charge and ion
-    vector<VECTOR3D> gradGion;        // gradient of the above
-
     // member functions
 
     // make a vertex
@@ -90,7 +68,7 @@ public:
         return;
     }
 
-    void new_update_velocity(double dt, THERMOSTAT main_bath, long double expfac) {
+    void new_update_velocity(double dt, THERMOSTAT main_bath, REAL expfac) {
 //     vw = vw * expfac + 0.5 * dt * (fw / (mu)) * (expfac - 1) / (-0.5 * dt * main_bath.xi);
         vw = vw * expfac + 0.5 * dt * (fw / (mu)) * sqrt(expfac);
         return;